@@ -0,0 +1,231 @@
+// Бенчмарк виртуальной машины для хостовой сборки (pio run -e native).
+// Запуск: .pio/build/native/program [итерации]
+//
+// Каждая программа прогоняется в трёх режимах: предекодирование со слиянием
+// суперинструкций (fused), без слияния (decoded) и интерпретация байткода
+// напрямую из памяти (raw).
+// Для каждой программы выводится число выполненных инструкций за прогон,
+// пропускная способность (инструкций/с), среднее время на инструкцию (нс/оп)
+// и пиковое потребление памяти процессом.
+
+#include <Arduino.h>
+#include <chrono>
+#include <sys/resource.h>
+#include "vm.h"
+
+#define BENCH_DEFAULT_ITERATIONS 2000
+#define BENCH_WARMUP_ITERATIONS  50
+
+// Адреса, используемые программой копирования данных (вне области кода)
+#define BENCH_DATA_SRC   0x0800
+#define BENCH_DATA_DST   0x0C00
+#define BENCH_DATA_LEN   0x0200
+
+// Построитель байткода для тестовых программ
+struct ProgramBuilder {
+    uint8_t code[MEM_SIZE] = {0};
+    size_t size = 0;
+
+    // Сколько байт осталось до границы limit (с учётом завершающего HALT)
+    size_t room(size_t limit) const { return size + 1 < limit ? limit - size - 1 : 0; }
+
+    void emit(uint8_t b) { code[size++] = b; }
+    void emit32(uint32_t v) {
+        emit((v >> 24) & 0xFF);
+        emit((v >> 16) & 0xFF);
+        emit((v >> 8) & 0xFF);
+        emit(v & 0xFF);
+    }
+
+    void load(uint8_t r, uint32_t value)  { emit(OP_LOAD); emit(r); emit32(value); }
+    void store(uint8_t r, uint32_t addr)  { emit(OP_STORE); emit(r); emit32(addr); }
+    void ldw(uint8_t r, uint32_t addr)    { emit(OP_LDW); emit(r); emit32(addr); }
+    void stw(uint8_t r, uint32_t addr)    { emit(OP_STW); emit(r); emit32(addr); }
+    void alu(uint8_t op, uint8_t d, uint8_t a, uint8_t b) { emit(op); emit(d); emit(a); emit(b); }
+    void push(uint8_t r) { emit(OP_PUSH); emit(r); }
+    void pop(uint8_t r)  { emit(OP_POP); emit(r); }
+    void syscall(uint8_t code) { emit(OP_SYSCALL); emit(code); }
+    void jnz(uint8_t r, uint32_t addr) { emit(OP_JNZ); emit(r); emit32(addr); }
+    void call(uint32_t addr) { emit(OP_CALL); emit32(addr); }
+    void ret() { emit(OP_RET); }
+    void halt() { emit(OP_HALT); }
+};
+
+// Арифметика: длинная развёрнутая цепочка ADD/SUB/MUL/DIV
+static void buildArithmetic(ProgramBuilder& p) {
+    p.load(1, 3);
+    p.load(2, 7);
+    p.load(0, 1);
+    while (p.room(MEM_SIZE) >= 16) {
+        p.alu(OP_ADD, 0, 0, 1);
+        p.alu(OP_MUL, 3, 0, 2);
+        p.alu(OP_SUB, 4, 3, 1);
+        p.alu(OP_DIV, 5, 4, 2);
+    }
+    p.halt();
+}
+
+// Работа со стеком: заполнение и опустошение стека через все регистры
+static void buildStackChurn(ProgramBuilder& p) {
+    for (uint8_t r = 0; r < NUM_REGS; r++) p.load(r, r * 11);
+    while (p.room(MEM_SIZE) >= NUM_REGS * 4) {
+        for (uint8_t r = 0; r < NUM_REGS; r++) p.push(r);
+        for (uint8_t r = NUM_REGS; r > 0; r--) p.pop(r - 1);
+    }
+    p.halt();
+}
+
+// Копирование данных системным вызовом LOAD_DATA
+static void buildLoadData(ProgramBuilder& p) {
+    p.load(0, BENCH_DATA_DST);
+    p.load(1, BENCH_DATA_SRC);
+    p.load(2, BENCH_DATA_LEN);
+    while (p.room(BENCH_DATA_SRC) >= 2) {
+        p.syscall(0x02);
+    }
+    p.halt();
+    for (uint32_t i = 0; i < BENCH_DATA_LEN; i++) {
+        p.code[BENCH_DATA_SRC + i] = i & 0xFF;
+    }
+    p.size = BENCH_DATA_SRC + BENCH_DATA_LEN;
+}
+
+// Смешанная нагрузка: загрузка констант, арифметика и запись в память
+static void buildMixed(ProgramBuilder& p) {
+    uint32_t addr = 0x0E00;
+    while (p.room(0x0E00) >= 20) {
+        p.load(1, addr);
+        p.alu(OP_ADD, 0, 0, 1);
+        p.store(0, addr);
+        addr = (addr + 4 < MEM_SIZE - 4) ? addr + 4 : 0x0E00;
+    }
+    p.halt();
+}
+
+// Цикл со счётчиком: тело из четырёх операций и условный переход
+static void buildLoop(ProgramBuilder& p) {
+    p.load(1, 20000);
+    p.load(2, 1);
+    p.load(6, 3);
+    uint32_t top = p.size;
+    p.alu(OP_ADD, 0, 0, 1);
+    p.alu(OP_MUL, 3, 0, 6);
+    p.alu(OP_CMP, 4, 3, 0);
+    p.alu(OP_SUB, 1, 1, 2);
+    p.jnz(1, top);
+    p.halt();
+}
+
+// Цикл над сегментом данных: чтение, изменение и запись слов (LDW/STW)
+static void buildDataWords(ProgramBuilder& p) {
+    p.load(1, 10000);
+    p.load(2, 1);
+    uint32_t top = p.size;
+    p.ldw(0, 0x10);
+    p.alu(OP_ADD, 0, 0, 1);
+    p.stw(0, 0x10);
+    p.ldw(3, 0x14);
+    p.alu(OP_ADD, 3, 3, 0);
+    p.stw(3, 0x14);
+    p.alu(OP_SUB, 1, 1, 2);
+    p.jnz(1, top);
+    p.halt();
+}
+
+// Вызов подпрограммы в цикле
+static void buildCall(ProgramBuilder& p) {
+    p.load(1, 10000);
+    p.load(2, 1);
+    uint32_t top = p.size;
+    p.call(0);                  // адрес подпрограммы подставляется ниже
+    uint32_t callSite = p.size - 4;
+    p.alu(OP_SUB, 1, 1, 2);
+    p.jnz(1, top);
+    p.halt();
+    uint32_t sub = p.size;
+    p.alu(OP_ADD, 0, 0, 1);
+    p.ret();
+    p.code[callSite]     = (sub >> 24) & 0xFF;
+    p.code[callSite + 1] = (sub >> 16) & 0xFF;
+    p.code[callSite + 2] = (sub >> 8) & 0xFF;
+    p.code[callSite + 3] = sub & 0xFF;
+}
+
+struct BenchCase {
+    const char* name;
+    void (*build)(ProgramBuilder&);
+};
+
+static const BenchCase cases[] = {
+    {"arith",     buildArithmetic},
+    {"stack",     buildStackChurn},
+    {"load_data", buildLoadData},
+    {"mixed",     buildMixed},
+    {"loop",      buildLoop},
+    {"data",      buildDataWords},
+    {"call",      buildCall},
+};
+
+static long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Прогон одной программы в заданном режиме и вывод строки результатов
+static void runCase(VirtualMachine& vm, const char* name, const ProgramBuilder& program,
+                    const char* mode, long iterations) {
+    bool predecode = strcmp(mode, "raw") != 0;
+    vm.setFusion(strcmp(mode, "fused") == 0);
+
+    for (long i = 0; i < BENCH_WARMUP_ITERATIONS; i++) {
+        vm.loadProgram(program.code, program.size, predecode);
+        vm.run();
+    }
+
+    uint64_t totalNs = 0;
+    uint64_t totalInstr = 0;
+    for (long i = 0; i < iterations; i++) {
+        vm.loadProgram(program.code, program.size, predecode);
+        auto start = std::chrono::steady_clock::now();
+        vm.run();
+        auto end = std::chrono::steady_clock::now();
+        totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        totalInstr += vm.instructionCount();
+    }
+
+    double nsPerOp = totalInstr ? static_cast<double>(totalNs) / totalInstr : 0.0;
+    double instrPerSec = totalNs ? totalInstr * 1e9 / totalNs : 0.0;
+    printf("%-10s %-8s %8zu %12llu %14.0f %10.2f %10ld\n",
+           name, mode, program.size,
+           static_cast<unsigned long long>(totalInstr / iterations),
+           instrPerSec, nsPerOp, peakRssKb());
+}
+
+// В тестовой сборке (pio test) точку входа задаёт тест
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char** argv) {
+    long iterations = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    if (iterations <= 0) iterations = BENCH_DEFAULT_ITERATIONS;
+
+    // ВМ хранит состояние в /system/systemdata.dat, поэтому каталог должен существовать
+    LittleFS.begin(true);
+    if (!LittleFS.exists("/system")) LittleFS.mkdir("/system");
+    VirtualMachine* vm = new VirtualMachine();
+
+    printf("VM benchmark: %ld iterations, sizeof(VirtualMachine) = %zu bytes\n",
+           iterations, sizeof(VirtualMachine));
+    printf("%-10s %-8s %8s %12s %14s %10s %10s\n",
+           "program", "mode", "bytes", "instr/run", "instr/s", "ns/op", "rss KB");
+
+    for (const BenchCase& bench : cases) {
+        ProgramBuilder program;
+        bench.build(program);
+        runCase(*vm, bench.name, program, "fused", iterations);
+        runCase(*vm, bench.name, program, "decoded", iterations);
+        runCase(*vm, bench.name, program, "raw", iterations);
+    }
+    delete vm;
+    return 0;
+}
+#endif // PIO_UNIT_TESTING
@@ -0,0 +1,44 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <Arduino.h>
+#include "peephole.h"
+
+// Ассемблер байткода ВМ: исходник читается построчно в два прохода (первый — адреса
+// меток и размеры секций, второй — вывод), поэтому размер исходника не ограничен памятью.
+//
+// Синтаксис строки:   [метка:] [мнемоника операнды | директива] [; комментарий]
+//   Мнемоники — все опкоды vm.h (halt, jmp, call, ret, jz, jnz, load, store, ldw, stw,
+//   add, sub, mul, div, cmp, push, pop, syscall), регистры r0..r7, операнды через запятую.
+//   Числа: 123, -5, 0x1F, 0b101, 'A'; выражения из чисел и символов с + - * /.
+//   NAME = выражение и .const NAME выражение — константы (значение известно на месте
+//   определения). Заранее определены PRINT_STRING, LOAD_DATA, CHECKPOINT.
+//   .code / .rodata / .data — текущая секция; .byte, .word, .string (с нулём в конце),
+//   .ascii, .space N [заполнитель], .align N — данные.
+//
+// Без секций .rodata/.data результат — плоская программа (загружается с адреса 0),
+// иначе — образ AIRV (vm.h): метки .rodata и .data — адреса в сегменте данных.
+// .word в коде записывается в big-endian (как операнды инструкций), в сегменте
+// данных — в порядке байт слова ВМ (little-endian), чтобы LDW читал то же значение.
+// Рядом с результатом пишется карта символов <output>.map.
+#define ASM_LINE_MAX     128
+#define ASM_MAX_SYMBOLS  128
+#define ASM_SYMBOL_MAX   24
+#define ASM_MAP_SUFFIX   ".map"
+
+struct AsmResult {
+    uint32_t codeSize;
+    uint32_t rodataSize;
+    uint32_t dataSize;
+    uint16_t symbols;
+    bool image;              // Записан образ AIRV (есть секции данных)
+    PeepholeStats optimized; // Работа оптимизатора (optimize)
+    uint32_t errorLine;      // Строка исходника с ошибкой (0 — ошибка не в строке)
+    char error[96];
+};
+
+// Сборка sourcePath в outputPath и карты символов; optimize — через оконный оптимизатор
+// (peephole.h). При ошибке файлы не остаются
+bool assembleFile(const String& sourcePath, const String& outputPath, bool optimize, AsmResult& result);
+
+#endif // ASSEMBLER_H
@@ -9,5 +9,6 @@
 #include "commands/logs.h"
 #include "commands/system.h"
 #include "commands/programs.h"
+#include "commands/filters.h"
 
 #endif
\ No newline at end of file
@@ -6,21 +6,51 @@
 #define EEPROM_SIZE 512
 #define MAX_ENV_VARS 20
 
+// Переменные хранятся журналом из записей [вид][длина ключа][длина значения][ключ]
+// [значение][контрольная сумма]. В EEPROM после заголовка ENV_LOG_MAGIC лежит снимок —
+// по записи на переменную; setenv/unsetenv дописывают одну запись в файл ENV_LOG_FILE
+// на LittleFS, не трогая EEPROM. Когда файл дорастает до ENV_LOG_FILE_MAX, снимок
+// переписывается текущими значениями одним EEPROM.commit(), а файл удаляется (сжатие).
+// При загрузке снимок и файл проигрываются до первой испорченной записи.
+#define ENV_LOG_MAGIC     "ENV1"
+#define ENV_LOG_START     4
+#define ENV_LOG_FILE      "/system/env.log"
+#define ENV_LOG_FILE_MAX  1024
+#define ENV_HASH_SIZE   64      // Слоты индекса (степень двойки, больше 2 * MAX_ENV_VARS)
+
 struct EnvVar {
     String key;
     String value;
+    uint32_t hash;
 };
 
 
 String getEnvVar(const String& key);
-void setEnvVar(const String& key, const String& value);
+// Значение переменной без создания строк (поиск по хэшу); nullptr — переменной нет
+const String* findEnvVar(const char* key, size_t length);
+// false — переменная не сохранена: нет места в таблице или в EEPROM
+bool setEnvVar(const String& key, const String& value);
 void unsetEnvVar(const String& key);
 void loadEnvVars();
-void saveEnvVars();
-void handleSetEnv(String args);
-void handleGetEnv(String args);
-void handleUnsetEnv(String args);
+// Перезапись снимка в EEPROM текущими значениями и удаление файла журнала (сжатие)
+bool saveEnvVars();
+
+// Пакет изменений: между envBegin и envCommit setenv/unsetenv меняют только таблицу в памяти,
+// envCommit записывает все изменения одной перезаписью журнала. Пакеты вкладываются (skript
+// внутри скрипта): запись — при закрытии внешнего, откат на любом уровне отменяет весь пакет
+// (таблица перечитывается из EEPROM). envCommit возвращает false, если пакет был отменён
+// или запись не удалась.
+void envBegin();
+bool envCommit();
+void envRollback();
+bool envInBatch();
+void handleSetEnv(int argc, const char* argv[]);
+void handleGetEnv(int argc, const char* argv[]);
+void handleUnsetEnv(int argc, const char* argv[]);
 void handlePrintEnv();
+void handleEnvBegin();
+void handleEnvCommit();
+void handleEnvRollback();
 
 extern EnvVar envVars[MAX_ENV_VARS];
 extern int envVarCount;
@@ -12,8 +12,8 @@ void deleteFile(const String &path);
 void createDir(const String &path);
 void deleteDir(const String &path);
 void changeDir(const String &path);
-void copyFile(const String &args);
-void moveFile(const String &args);
+void copyFile(const String &sourceName, const String &destName);
+void moveFile(const String &sourceName, const String &destName);
 String formatSize(size_t bytes);
 void printFSInfo();
 void printWorkingDir();
@@ -0,0 +1,23 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <Arduino.h>
+#include "pipeline.h"
+
+#define FILTER_DEFAULT_LINES  10
+#define TAIL_BUFFER_SIZE      2048   // Хвост потока, из которого tail берёт строки
+
+// Фильтр по имени команды (grep, head, tail, wc) для стадии конвейера.
+// fileArg — индекс аргумента-файла (0 — файла нет). nullptr — неизвестная команда
+// или ошибка в аргументах (сообщение уже выведено).
+PipeFilter* createFilter(int argc, const char* argv[], int& fileArg);
+bool isFilterCommand(const char* name);
+// Пропуск файла через фильтр; false — файл не открылся
+bool filterFile(PipeFilter& filter, const String& path);
+
+void handleGrep(int argc, const char* argv[]);
+void handleHead(int argc, const char* argv[]);
+void handleTail(int argc, const char* argv[]);
+void handleWc(int argc, const char* argv[]);
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 
-void handleRun(String args);
+void handleRun(int argc, const char* argv[]);
+void handleBg(int argc, const char* argv[]);
+void handlePs();
+void handleKill(int argc, const char* argv[]);
 
 #endif
\ No newline at end of file
@@ -4,8 +4,9 @@
 #include <Arduino.h>
 #include <WString.h>
 
-void handleInfoLog();
-void handleErrLog();
+// infolog/errlog [N] — последние N записей журнала (log.h)
+void handleInfoLog(int argc, const char* argv[]);
+void handleErrLog(int argc, const char* argv[]);
 void handleClearLog(String type);
 
-#endif
\ No newline at end of file
+#endif
@@ -3,9 +3,13 @@
 
 #include "Arduino.h"
 
-void handleEcho(String args);
-void catFile(String path);
-void handleCompile(String args);
-void handleScript(String args);
+void handleEcho(int argc, const char* argv[]);
+void handleCat(int argc, const char* argv[]);
+// compile <file> <bytecode>: bytecode (argv[2]) передаётся без разбора кавычек — в нём есть 'A
+void handleCompile(int argc, const char* argv[]);
+// asm [-O] <source> [output]: сборка исходника ассемблера (assembler.h), по умолчанию в <source>.bin;
+// -O — с оконным оптимизатором (peephole.h) и отчётом о сэкономленных инструкциях
+void handleAsm(int argc, const char* argv[]);
+void handleScript(int argc, const char* argv[]);
 
 #endif
\ No newline at end of file
@@ -1,8 +1,16 @@
 #ifndef SYSTEM_H
 #define SYSTEM_H
 
+#include <Arduino.h>
+
 void handleStatus();
 void handleShutdown();
 void handleReboot();
 
-#endif
\ No newline at end of file
+// Учёт времени загрузки: этап phase длился от start (micros()) до текущего момента.
+// Этапы, записанные после bootFinished(), выводятся отдельно как отложенные.
+void bootRecord(const char* phase, uint32_t start);
+void bootFinished();
+void handleBootTime();
+
+#endif
@@ -5,9 +5,32 @@
 #include <LittleFS.h>
 
 String normalizePath(String path);
-bool checkArgs(String args, int required);
+String joinArgs(int argc, const char* argv[], int from);
 void writeOutput(const String &text);
-void printLastLines(String path, int lines);
+void writeOutput(const char* data, size_t length);
+String column(const String& text, unsigned int width);
+void printLastLines(const String& path, uint32_t lines);
+
+// Общий путь поблочного чтения файлов (cat, cp, head/tail/grep/wc над файлом, логи): файл
+// читается блоками по FILE_BLOCK_SIZE байт в один статический буфер (команды исполняются по
+// одной) и передаётся в sink без промежуточных String. sink возвращает false, когда ввод
+// больше не нужен. Результат — число переданных байт.
+#define FILE_BLOCK_SIZE 512
+typedef bool (*BlockSink)(const char* data, size_t length, void* context);
+size_t streamFile(fs::File& file, BlockSink sink, void* context);
+// sink вывода команды: writeOutput, пока конвейер принимает ввод
+bool outputSink(const char* data, size_t length, void* context);
+// Получатель вывода программы ВМ (VirtualMachine::OutputHandler): тем же путём, что и
+// вывод команд, с перенаправлением и конвейером
+void writeProgramOutput(const char* text, size_t length, void* context);
+
+// Последние lines строк файла: блоки читаются с конца до lines-го перевода строки, затем
+// хвост выводится через streamFile. follow — дальше раз в TAIL_FOLLOW_POLL_MS выводится
+// дописанное в файл (файл стал короче — вывод с начала), до любого ввода в консоли.
+// Во время слежения работают фоновые программы и журнал (serviceBackground()).
+// false — файл не открылся
+#define TAIL_FOLLOW_POLL_MS 250
+bool tailFile(const String& path, uint32_t lines, bool follow);
 
 extern fs::File outputFile;
 extern bool outputRedirected;
@@ -14,13 +14,13 @@ void addWifiToList(const String& ssid, const String& password);
 bool findWifiInList(const String& ssid, String& password);
 WifiConfig readWifiConfig();
 void writeWifiConfig(const WifiConfig& config);
-void handleWifi(String args);
-void handleWifiMode(String args);
-void handleWifiCreate(String args);
-void handleWifiConnect(String args);
+void handleWifi(int argc, const char* argv[]);
+void handleWifiMode(int argc, const char* argv[]);
+void handleWifiCreate(int argc, const char* argv[]);
+void handleWifiConnect(int argc, const char* argv[]);
 void handleWifiInfo();
 void handleWifiList();
-void handleWifiRemove(String args);
+void handleWifiRemove(int argc, const char* argv[]);
 bool isWifiExists(const String& ssid);
 
 #endif
\ No newline at end of file
@@ -3,15 +3,25 @@
 
 #include <WString.h>
 #include <Arduino.h>
-
-struct Command {
-    String name;
-    String args;
-};
+#include "tokenizer.h"
 
 void initializeFS();
-void handleCommand(String input);
+// Разбор строки (tokenizer.h), перенаправление вывода и вызов обработчика команды
+void handleCommand(const char* input);
+// Части handleCommand для кэша скриптов: номер команды в начале строки (-1 — неизвестная),
+// способ разбора её аргументов, исполнение уже разобранной строки и отпечаток таблицы команд
+int lookupCommand(const char* input);
+uint8_t commandRawFrom(int index);
+void executeCommand(int index, CommandLine& line);
+uint32_t commandTableHash();
+// Ошибка последней команды: неизвестная команда, ошибка разбора, нехватка аргументов или
+// отказ, о котором сообщил обработчик (setCommandFailed). Сбрасывается перед каждой командой.
+// По нему skript останавливается и откатывает изменения окружения.
+void setCommandFailed();
+bool lastCommandFailed();
 void printHelp();
-Command parseCommand(String input);
+// Фоновая работа между командами (из loop() и из команд, ждущих подолгу, как tail -f):
+// сообщения задачи ВМ или, без неё, срез фоновым программам, и сброс буферов журнала
+void serviceBackground();
 
 #endif
\ No newline at end of file
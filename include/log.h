@@ -0,0 +1,55 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+
+// Журнал системы: двоичные записи (уровень, время millis(), метка источника, текст)
+// в двух каналах — информационном (LOG_INFO и ниже) и ошибок (LOG_ERROR). Канал —
+// кольцо из LOG_SEGMENTS файлов /system/outputs/<канал>.<N>.log по LOG_SEGMENT_SIZE
+// байт: когда запись не помещается в текущий сегмент, самый старый перезаписывается,
+// поэтому журнал не занимает больше LOG_SEGMENTS * LOG_SEGMENT_SIZE байт на канал.
+// Записи копятся в буфере канала и дописываются в сегмент одним блоком — при
+// заполнении буфера, из logTick() через LOG_FLUSH_INTERVAL_MS после первой записи
+// и в logFlush(); записи LOG_ERROR дописываются сразу.
+// Писать можно из любой задачи (консоль, задача ВМ) после logBegin().
+#define LOG_SEGMENTS          4
+#define LOG_SEGMENT_SIZE      4096
+#define LOG_BUFFER_SIZE       512     // Буфер канала в ОЗУ
+#define LOG_FLUSH_INTERVAL_MS 1000
+#define LOG_TAG_MAX           15
+#define LOG_TEXT_MAX          160
+#define LOG_PRINT_DEFAULT     6       // Записей в infolog/errlog без аргумента
+
+// Записи ниже этого уровня не пишутся (флаг сборки -DLOG_LEVEL_MIN=0 включает отладочные)
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN         LOG_INFO
+#endif
+
+enum LogLevel : uint8_t {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+};
+
+enum LogChannel : uint8_t {
+    LOG_CHANNEL_INFO,
+    LOG_CHANNEL_ERROR,
+    LOG_CHANNELS,
+};
+
+// Поиск текущих сегментов каналов (после монтирования LittleFS)
+void logBegin();
+// Запись в журнал; метка и текст обрезаются до LOG_TAG_MAX и LOG_TEXT_MAX байт
+void logMessage(LogLevel level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+// Сброс буферов, в которых записи лежат дольше LOG_FLUSH_INTERVAL_MS (из loop())
+void logTick();
+// Сброс буферов обоих каналов (перед перезагрузкой и выключением)
+void logFlush();
+// Вывод последних count записей канала: "[секунды.мс] УРОВЕНЬ метка: текст"
+void logPrint(LogChannel channel, uint32_t count);
+// Удаление сегментов канала
+void logClear(LogChannel channel);
+
+#endif // LOG_H
@@ -0,0 +1,29 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+// Вывод консоли через кольцевой буфер: writeOutput() только копирует байты, а фоновая
+// задача (на хосте — поток) пишет их пачками в Serial или в файл перенаправления.
+// Писать в буфер может только задача консоли. Пока буфер полон, она ждёт
+// (обратное давление); outputFlush() — явная точка, после которой всё записанное
+// уже отдано получателю. До outputBegin() и при сборке с -DOUTPUT_ASYNC=0 вывод синхронный.
+#ifndef OUTPUT_ASYNC
+#define OUTPUT_ASYNC 1
+#endif
+
+#define OUTPUT_BUFFER_SIZE  4096   // Ёмкость буфера (степень двойки)
+#define OUTPUT_CHUNK_SIZE   256    // Наибольшая пачка одной записи получателю
+#define OUTPUT_STACK_SIZE   3072
+#define OUTPUT_PRIORITY     2
+
+// Запуск фоновой записи; false — задачу создать не удалось (вывод остаётся синхронным)
+bool outputBegin();
+void outputWrite(const char* data, size_t length);
+// Ожидание, пока всё записанное дойдёт до получателя
+void outputFlush();
+// Смена получателя (nullptr — Serial); накопленное до этого уходит прежнему получателю
+void outputRedirect(fs::File* file);
+
+#endif // OUTPUT_H
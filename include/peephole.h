@@ -0,0 +1,38 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <Arduino.h>
+
+// Оконный оптимизатор байткода (asm -O). Окно — участок базового блока без меток и
+// переходов (до PEEPHOLE_WINDOW инструкций), на выходе регистры считаются живыми.
+//   - свёртка констант: add/sub/mul/div/cmp над регистрами с известными значениями -> load
+//   - удаление мёртвых записей: load и арифметика в регистр, перезаписанный до чтения
+//   - удаление пары push r / pop r
+//   - упрощение: mul на 2 -> add r, r; mul/div на 1, add/sub 0 в тот же регистр удаляются
+//     (сдвигов в ВМ нет, поэтому остальные степени двойки не заменяются)
+// Свёртка выполняется, только если окно от неё не становится длиннее.
+#define PEEPHOLE_WINDOW  16
+
+struct PeepholeInstr {
+    uint8_t opcode;
+    uint8_t regs[3];
+    uint32_t value;          // Непосредственный операнд (адрес или число)
+    bool known;              // value не зависит от адресов меток — одинаков на обоих проходах
+};
+
+struct PeepholeStats {
+    uint16_t folded;         // Свёрнуто в load
+    uint16_t deadStores;     // Удалено мёртвых записей
+    uint16_t pushPop;        // Удалено пар push/pop
+    uint16_t simplified;     // Упрощено арифметических инструкций
+    uint32_t removed;        // Всего удалено инструкций
+    uint32_t bytesSaved;
+};
+
+// Участвует ли опкод в окне (остальные инструкции заканчивают окно)
+bool peepholeCandidate(uint8_t opcode);
+
+// Оптимизация окна на месте; возвращает новое число инструкций
+size_t optimizeWindow(PeepholeInstr* window, size_t count, PeepholeStats& stats);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,56 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+
+// Конвейер команд "a | b | c": вывод первой команды (всё, что она пишет через writeOutput)
+// проталкивается по цепочке фильтров, последний фильтр пишет в вывод консоли.
+// Каждый фильтр держит только ограниченный буфер (строку или хвост потока), поэтому
+// промежуточные данные не попадают ни в файлы, ни в кучу целиком.
+#define PIPE_LINE_MAX  256   // Буфер строки фильтра; более длинные строки режутся на части
+
+class PipeFilter {
+public:
+    virtual ~PipeFilter() {}
+    // Очередная порция входного потока
+    virtual void write(const char* data, size_t length) = 0;
+    // Конец входного потока: фильтр выдаёт накопленное
+    virtual void finish() {}
+    // true — фильтру (и всем после него) вход больше не нужен, источник может остановиться
+    virtual bool closed() const { return next ? next->closed() : false; }
+
+    PipeFilter* next = nullptr;   // Следующий фильтр; nullptr — выход конвейера
+    bool toConsole = false;       // Последний фильтр конвейера пишет прямо в вывод консоли
+    PipeFilter* outer = nullptr;  // ...или во внешний конвейер, если команда вложенная
+
+protected:
+    void emit(const char* data, size_t length);
+};
+
+// Фильтр, обрабатывающий вход по строкам (строка передаётся вместе с '\n', если он был)
+class LineFilter : public PipeFilter {
+public:
+    void write(const char* data, size_t length) override;
+    void finish() override;
+
+protected:
+    virtual void line(const char* text, size_t length) = 0;
+
+private:
+    char buffer[PIPE_LINE_MAX];
+    size_t used = 0;
+};
+
+// Подключение цепочки фильтров к writeOutput(). Возвращает ранее подключённый конвейер:
+// вложенная команда (строка skript) подключает свой поверх внешнего, и её последний
+// фильтр пишет во внешний конвейер, а не в консоль
+PipeFilter* pipeBegin(PipeFilter* first);
+// Завершение потока: finish() для фильтров по порядку, затем writeOutput() снова
+// пишет в конвейер outer, который вернул pipeBegin() (nullptr — в консоль)
+void pipeEnd(PipeFilter* outer);
+// Передача данных в конвейер; false — конвейер не подключён
+bool pipeWrite(const char* data, size_t length);
+// true — подключённому конвейеру вход больше не нужен (например, head уже вывел свои строки)
+bool pipeClosed();
+
+#endif // PIPELINE_H
@@ -0,0 +1,64 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "vm.h"
+
+#define SCHED_MAX_TASKS     4       // Одновременно работающих фоновых программ
+#define SCHED_SLICE_BUDGET  2000    // Инструкций на программу за один такт планировщика
+
+// Ошибки запуска фоновой программы (spawn возвращает id >= 0 или одно из значений)
+#define SCHED_ERR_NO_SLOT    -1     // Все слоты заняты
+#define SCHED_ERR_NO_MEMORY  -2     // Не удалось создать ВМ
+#define SCHED_ERR_PROGRAM    -3     // Программа не помещается в память или образ некорректен
+
+// Фоновая программа: собственная ВМ со своим файлом состояния
+struct VmTask {
+    bool used = false;
+    uint16_t id = 0;                // Номер для ps/kill (растёт с каждым запуском)
+    String name;                    // Путь к программе
+    VirtualMachine* vm = nullptr;
+    uint32_t slices = 0;            // Сколько тактов программа получила
+    char stateFile[24] = {0};       // /system/task<slot>.dat
+};
+
+// Кооперативный планировщик: каждый такт (из loop() или между срезами
+// программы переднего плана) каждая фоновая ВМ исполняет не больше
+// SCHED_SLICE_BUDGET инструкций и возвращает управление.
+class Scheduler {
+public:
+    // Получатель сообщений о завершении программ
+    typedef void (*Reporter)(const String& text);
+
+private:
+    VmTask tasks[SCHED_MAX_TASKS];
+    uint16_t nextId = 1;
+    uint8_t cursor = 0;             // С какого слота начинать следующий такт
+    Reporter reporter = nullptr;    // nullptr — writeOutput()
+    VirtualMachine::OutputHandler programOutput = nullptr;  // nullptr — writeOutput()
+
+    void finish(VmTask& task, const char* reason);
+
+public:
+    // Куда направлять отчёты о завершении и вывод программ (для исполнения в другой задаче)
+    void setReporter(Reporter handler) { reporter = handler; }
+    void setProgramOutput(VirtualMachine::OutputHandler handler) { programOutput = handler; }
+
+    // Загрузка программы из открытого файла в новую фоновую ВМ
+    int32_t spawn(File& file, const String& name);
+    bool kill(uint16_t id);
+    // Один такт: по срезу каждой работающей программе; завершившиеся освобождаются
+    void tick();
+    uint32_t count() const;
+    const VmTask& slot(uint8_t index) const { return tasks[index]; }
+    // Таблица для команды ps
+    String listing() const;
+};
+
+// Текст результата spawn() для консоли
+String spawnMessage(int32_t result, const String& name);
+
+extern Scheduler scheduler;
+
+#endif // SCHEDULER_H
@@ -0,0 +1,20 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include <Arduino.h>
+
+// Кэш скриптов skript: при первом запуске скрипт разбирается целиком и сохраняется рядом
+// с исходником (<file>.skc) — для каждой строки номер команды, готовые argv и файл
+// перенаправления. Следующие запуски исполняют записи без разбора. Строки с $VAR и
+// конвейеры хранятся текстом и разбираются при каждом запуске (их разбор зависит от
+// окружения). Кэш пересобирается, если изменились размер или время записи исходника,
+// таблица команд или формат кэша.
+#define SCRIPT_CACHE_SUFFIX  ".skc"
+#define SCRIPT_CACHE_MAGIC   "SKC1"
+
+// Исполнение скрипта через кэш. false — кэш неприменим (ФС не хранит время записи,
+// слишком длинная строка, не удалось записать кэш); в этом случае скрипт не исполнялся.
+// Исполнение останавливается на первой команде с ошибкой (lastCommandFailed), ok = false
+bool runCachedScript(const String& path, bool& ok);
+
+#endif // SCRIPT_CACHE_H
@@ -0,0 +1,43 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Очередь без блокировок для одного писателя и одного читателя (разные задачи/ядра).
+// Ёмкость N — степень двойки; head пишет только читатель, tail — только писатель.
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "Ёмкость очереди должна быть степенью двойки");
+
+private:
+    T items[N];
+    std::atomic<uint32_t> head{0};  // Следующий элемент для чтения
+    std::atomic<uint32_t> tail{0};  // Следующее место для записи
+
+public:
+    // Вызывается только писателем; false — очередь заполнена
+    bool push(const T& item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Вызывается только читателем; false — очередь пуста
+    bool pop(T& item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif // SPSC_QUEUE_H
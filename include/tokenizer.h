@@ -0,0 +1,49 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <Arduino.h>
+
+// Разбор командной строки в argv за один проход, без выделения памяти:
+// слова разделяются пробелами; '...' — текст как есть; "..." — с экранированием и
+// подстановкой переменных; \n \t \r \\ \$ \" \' \> \# и "\ " вне одинарных кавычек —
+// экранирование; $VAR и ${VAR} — значение переменной окружения; '>' и '>>' —
+// перенаправление вывода; '|' — граница команд конвейера; '#' в начале слова —
+// комментарий до конца строки. Слова (после подстановки) пишутся в фиксированный буфер CommandLine.
+#define COMMAND_MAX_ARGS    16  // Слов во всей строке (все команды конвейера)
+#define COMMAND_MAX_STAGES  4   // Команд в конвейере
+#define COMMAND_LINE_MAX    512 // Буфер для всех слов строки вместе с завершающими нулями
+
+enum TokenizeStatus : uint8_t {
+    TOKENIZE_OK,
+    TOKENIZE_EMPTY,          // Пустая строка или комментарий
+    TOKENIZE_TOO_MANY,       // Больше COMMAND_MAX_ARGS слов
+    TOKENIZE_TOO_LONG,       // Слова не поместились в буфер
+    TOKENIZE_UNTERMINATED,   // Незакрытая кавычка или ${
+    TOKENIZE_NO_TARGET,      // После '>' нет имени файла
+    TOKENIZE_EMPTY_STAGE,    // Пустая команда в конвейере ("a | | b", "a |")
+    TOKENIZE_TOO_MANY_STAGES,// Больше COMMAND_MAX_STAGES команд в конвейере
+};
+
+// Слова команд конвейера лежат в argv подряд, каждая команда завершена nullptr:
+// команда i — stageArgc(i) слов начиная с stageArgv(i). argc/argv — первая команда.
+struct CommandLine {
+    int argc;
+    const char* argv[COMMAND_MAX_ARGS + COMMAND_MAX_STAGES];
+    uint8_t stages;
+    uint8_t stageStart[COMMAND_MAX_STAGES];
+    uint8_t stageLength[COMMAND_MAX_STAGES];
+    const char* redirect;                     // Файл перенаправления (для всего конвейера) или nullptr
+    bool append;                              // '>>' вместо '>'
+    bool expanded;                            // Были подстановки $VAR: разбор зависит от окружения
+    char scratch[COMMAND_LINE_MAX];
+
+    int stageArgc(uint8_t stage) const { return stageLength[stage]; }
+    const char** stageArgv(uint8_t stage) { return argv + stageStart[stage]; }
+};
+
+// rawFrom > 0: остаток строки начиная со слова argv[rawFrom] первой команды (до '>' или '|')
+// передаётся одним аргументом без обработки — для команд со своим синтаксисом аргументов
+TokenizeStatus tokenize(const char* line, CommandLine& out, uint8_t rawFrom = 0);
+const char* tokenizeError(TokenizeStatus status);
+
+#endif // TOKENIZER_H
@@ -8,34 +8,229 @@
 #define NUM_REGS     8      // Количество регистров
 #define STACK_SIZE   256    // Размер стека
 
+#define DATA_SIZE    4096   // Размер сегмента данных (байт), доступ словами по 4 байта
+#define DATA_WORDS   (DATA_SIZE / 4)
+
+#define STORAGE_SIZE       (MEM_SIZE + DATA_SIZE)  // Память кода и сегмент данных, сохраняемые в файл
+#define STORAGE_PAGE_SIZE  256  // Гранулярность отслеживания изменений памяти при сохранении
+#define STORAGE_PAGES      (STORAGE_SIZE / STORAGE_PAGE_SIZE)
+
+// Образ программы с сегментами. Заголовок (16 байт, числа big-endian, как в байткоде):
+//   0  "AIRV"             — сигнатура
+//   4  версия (1), 3 байта резерв
+//   8  размер кода        — загружается в память кода с адреса 0
+//   10 размер rodata      — начало сегмента данных, запись запрещена
+//   12 размер data        — сразу за rodata, остаток сегмента обнуляется
+//   14 резерв
+// Затем код, rodata и data подряд. Размеры rodata и data кратны 4, слова в них
+// хранятся в порядке байт целевой платформы (little-endian на ESP32 и x86).
+// Файл без сигнатуры загружается как плоский байткод (код и данные в одной памяти).
+#define IMAGE_MAGIC        "AIRV"
+#define IMAGE_VERSION      1
+#define IMAGE_HEADER_SIZE  16
+#define IMAGE_MAX_SIZE     (IMAGE_HEADER_SIZE + MEM_SIZE + DATA_SIZE)
+
+#define BLOCK_CACHE_SIZE  128   // Максимум декодированных базовых блоков в кэше
+#define BLOCK_HASH_SIZE   256   // Размер хеш-таблицы «адрес -> блок» (степень двойки)
+#define DECODE_POOL_MIN   64    // Начальная ёмкость пула декодированных инструкций
+#define DECODE_POOL_MAX   (MEM_SIZE / 2) // Больше инструкций в памяти не помещается
+#define PREDECODE_QUEUE   32    // Очередь адресов при предварительном декодировании программы
+#define SEQUENCE_STATS_MAX 64   // Максимум различных последовательностей в статистике слияния
+#define PROGRAM_LOAD_CHUNK 512  // Размер блока при чтении программы из файла в память ВМ
+#define VM_STATE_FILE      "/system/systemdata.dat" // Файл состояния ВМ по умолчанию
+
+// Способ диспетчеризации предекодированных инструкций (флаг сборки -DVM_DISPATCH=...):
+// VM_DISPATCH_SWITCH   — переносимый цикл со switch
+// VM_DISPATCH_THREADED — таблица адресов обработчиков (computed goto, GCC/Clang)
+#define VM_DISPATCH_SWITCH    0
+#define VM_DISPATCH_THREADED  1
+
+#ifndef VM_DISPATCH
+#if defined(__GNUC__)
+#define VM_DISPATCH VM_DISPATCH_THREADED
+#else
+#define VM_DISPATCH VM_DISPATCH_SWITCH
+#endif
+#endif
+
+// Редко исполняемые функции (обработка ошибок) — вне горячего кода
+#if defined(__GNUC__)
+#define VM_COLD __attribute__((cold, noinline))
+#else
+#define VM_COLD
+#endif
+
 // Определения опкодов для инструкций
 enum Opcode : uint8_t {
     // Управляющие инструкции
     OP_HALT       = 0x01,
+    OP_JMP        = 0x02,   // JMP <32-bit addr>
+    OP_CALL       = 0x03,   // CALL <32-bit addr>, адрес возврата помещается в стек
+    OP_RET        = 0x04,   // RET
+    OP_JZ         = 0x05,   // JZ reg, <32-bit addr>  — переход, если reg == 0
+    OP_JNZ        = 0x06,   // JNZ reg, <32-bit addr> — переход, если reg != 0
     OP_LOAD       = 0x10,
-    OP_STORE      = 0x11,
+    OP_STORE      = 0x11,   // В образе с сегментами пишет слово в сегмент данных (как STW)
+    OP_LDW        = 0x12,   // LDW reg, <32-bit addr> — слово из сегмента данных (адрес кратен 4)
+    OP_STW        = 0x13,   // STW reg, <32-bit addr> — слово в сегмент данных (не в rodata)
     OP_ADD        = 0x20,
     OP_SUB        = 0x21,
     OP_MUL        = 0x22,
     OP_DIV        = 0x23,
+    OP_CMP        = 0x28,   // CMP dst, src1, src2 => dst = 0 (==), 1 (>), 0xFFFFFFFF (<), без знака
     OP_PUSH       = 0x30,
     OP_POP        = 0x31,
     OP_SYSCALL    = 0xFF,
 };
 
+// Имя опкода для отчётов ("?" для неизвестного)
+const char* opcodeName(uint8_t opcode);
+
+// Коды ошибок исполнения
+enum VmFaultCode : uint8_t {
+    FAULT_NONE = 0,
+    FAULT_BAD_REGISTER,     // Номер регистра >= NUM_REGS (operand — номер регистра)
+    FAULT_BAD_ADDRESS,      // Адрес вне памяти (operand — адрес)
+    FAULT_DIV_ZERO,         // Деление на ноль (operand — регистр-делитель)
+    FAULT_STACK_OVERFLOW,   // operand — указатель стека
+    FAULT_STACK_UNDERFLOW,  // operand — указатель стека
+    FAULT_BAD_OPCODE,       // Неизвестный опкод (operand — опкод)
+    FAULT_BAD_SYSCALL,      // Неизвестный системный вызов (operand — код вызова)
+    FAULT_MEMORY_VIOLATION, // Выход за пределы памяти в LOAD_DATA (operand — адрес)
+    FAULT_PC_END,           // Исполнение дошло до конца памяти без HALT
+    FAULT_READONLY,         // Запись в rodata (operand — адрес в сегменте данных)
+    FAULT_NO_PROGRESS,      // run() с бюджетом не исполнил ни одной инструкции (operand — pc)
+};
+
+// Реакция на исправимые ошибки (неверный регистр, деление на ноль, стек, системные вызовы).
+// Ошибки передачи управления (переход за пределы памяти, неизвестный опкод,
+// CALL/RET без стека) останавливают ВМ всегда.
+enum VmFaultPolicy : uint8_t {
+    FAULT_POLICY_STOP,      // Остановить ВМ на первой ошибке
+    FAULT_POLICY_CONTINUE,  // Записать ошибку и продолжить (поведение как при отсутствии проверки)
+};
+
+// Запись об ошибке последнего запуска: первая ошибка и общее число ошибок.
+// ВМ ничего не выводит во время исполнения, отчёт формирует вызывающий код после run().
+struct VmFault {
+    VmFaultCode code;
+    uint8_t opcode;     // Опкод инструкции, вызвавшей ошибку
+    uint32_t pc;        // Адрес этой инструкции
+    uint32_t operand;   // Номер регистра, адрес или код (см. VmFaultCode)
+    uint32_t count;     // Сколько ошибок произошло за запуск
+};
+
+// Текстовое описание кода ошибки
+const char* faultName(VmFaultCode code);
+
+// Последовательность соседних опкодов и сколько раз она была исполнена
+struct OpcodeSequence {
+    uint8_t length;     // 2 или 3
+    uint8_t ops[3];
+    uint32_t count;
+    bool fused;         // Последовательность уже покрывается правилом слияния
+};
+
+// Данные профилировщика инструкций. Циклы — ESP.getCycleCount() (на хосте — TSC/нс),
+// время инструкции считается от её диспетчеризации до диспетчеризации следующей.
+struct VmProfile {
+    uint32_t opcodeCount[256];      // Исполнения по опкоду
+    uint64_t opcodeCycles[256];     // Суммарные циклы по опкоду
+    uint32_t pcCount[MEM_SIZE];     // Исполнения по адресу инструкции
+    uint32_t lastCycles;            // Отметка времени последней диспетчеризации
+    int16_t lastOpcode;             // Опкод, которому принадлежит текущий интервал (-1 — нет)
+};
+
 class VirtualMachine {
+public:
+    // Получатель вывода программы (PRINT_STRING); text не завершается нулём
+    typedef void (*OutputHandler)(const char* text, size_t length, void* context);
+
 private:
-    // Вложенная структура для работы с памятью и хранением состояния на файловой системе
+    // Внутренние коды предекодированных инструкций (плотная нумерация для таблицы переходов)
+    enum DecodedOp : uint8_t {
+        DOP_HALT,
+        DOP_LOAD,
+        DOP_STORE,
+        DOP_ADD,
+        DOP_SUB,
+        DOP_MUL,
+        DOP_DIV,
+        DOP_PUSH,
+        DOP_POP,
+        DOP_SYSCALL,
+        DOP_CMP,
+        DOP_JMP,
+        DOP_JZ,
+        DOP_JNZ,
+        DOP_CALL,
+        DOP_RET,
+        DOP_LDW,        // imm — индекс слова в сегменте данных
+        DOP_STW,
+        DOP_TRAP,       // Инструкция, которую нельзя декодировать: исполняется интерпретатором байткода
+        // Суперинструкции (см. правила слияния в fuseBlock)
+        DOP_LOAD_ADD,   // LOAD c, imm; ADD a, b, c
+        DOP_LOAD_SUB,   // LOAD c, imm; SUB a, b, c
+        DOP_LOAD_STORE, // LOAD a, imm; STORE a, addr — адрес в imm следующего слота
+        DOP_PUSH2,      // PUSH a; PUSH b
+        DOP_PUSH3,      // PUSH a; PUSH b; PUSH c
+        DOP_POP2,       // POP a; POP b
+        DOP_POP3,       // POP a; POP b; POP c
+        DOP_SUB_JNZ,    // SUB a, b, c; JNZ a, imm
+        DOP_COUNT
+    };
+
+    // Предекодированная инструкция фиксированной ширины (8 байт, выровнена по 4)
+    struct DecodedInstr {
+        uint8_t op;     // DecodedOp
+        uint8_t a;      // Первый операнд (регистр назначения / код системного вызова)
+        uint8_t b;      // Второй операнд (регистр-источник)
+        uint8_t c;      // Третий операнд (регистр-источник)
+        uint32_t imm;   // Непосредственное значение или адрес, уже собранный из big-endian
+    };
+
+    // Базовый блок: последовательность инструкций, заканчивающаяся переходом, HALT или TRAP.
+    // Преемники запоминаются при первом переходе, поэтому горячий цикл декодируется один раз,
+    // а дальше исполнение идёт от блока к блоку без поиска.
+    struct Block {
+        uint16_t start;     // Адрес первой инструкции
+        uint16_t end;       // Адрес после последней инструкции (адрес возврата для CALL)
+        uint16_t first;     // Индекс первой инструкции в пуле
+        uint16_t count;     // Количество инструкций
+        int16_t next[2];    // Преемники: [0] — следующий по порядку, [1] — цель перехода (-1 — неизвестен)
+        uint32_t hits;      // Сколько раз исполнение входило в блок
+    };
+
+    // Правило слияния: последовательность декодированных операций и построитель
+    // суперинструкции, возвращающий число занятых слотов (0 — операнды не подходят)
+    struct FusionRule {
+        uint8_t length;
+        uint8_t ops[3];       // DecodedOp
+        uint8_t opcodes[3];   // Исходные опкоды (для статистики последовательностей)
+        uint32_t (*build)(const DecodedInstr* in, DecodedInstr* out);
+    };
+    static const FusionRule fusionRules[];
+    static const uint32_t fusionRuleCount;
+
+    // Вложенная структура для работы с памятью и хранением состояния на файловой системе.
+    // Файл состояния — образ памяти, страница i лежит по смещению i * STORAGE_PAGE_SIZE.
+    // Страницы, изменённые после последнего сохранения или восстановления, отмечаются
+    // в маске dirty: persist() дописывает в файл только их, restore() только их перечитывает.
     struct Storage {
-        uint8_t ram[MEM_SIZE] = {0}; // Оперативная память (RAM)
-        const char* storageFile = "/system/systemdata.dat";
+        static_assert(STORAGE_SIZE % STORAGE_PAGE_SIZE == 0 && STORAGE_PAGES <= 32,
+                      "Маска изменённых страниц — одно 32-битное слово");
+        static_assert(MEM_SIZE % 4 == 0, "Сегмент данных должен быть выровнен по слову");
 
-        // Инициализация файловой системы и файла для хранения состояния
+        // Память кода (плоская память для байткода без сегментов) и за ней сегмент данных
+        uint32_t words[STORAGE_SIZE / 4] = {0};
+        uint8_t* const ram = reinterpret_cast<uint8_t*>(words); // Оперативная память (RAM)
+        uint32_t* const data = words + MEM_SIZE / 4;              // Сегмент данных
+        const char* storageFile = VM_STATE_FILE;
+        uint32_t dirty = 0;          // Страницы, отличающиеся от файла
+        bool restored = false;       // Память уже загружена из файла целиком
+
+        // Создание файла для хранения состояния (ФС к этому моменту смонтирована initializeFS())
         void init() {
-            if (!LittleFS.begin()) {
-                Serial.println("Failed to mount LittleFS");
-                return;
-            }
             if (!LittleFS.exists(storageFile)) {
                 File f = LittleFS.open(storageFile, "w");
                 if (f) f.close();
@@ -52,32 +247,80 @@ private:
         void write(uint32_t address, uint8_t value) {
             if (address < MEM_SIZE) {
                 ram[address] = value;
+                dirty |= 1u << (address / STORAGE_PAGE_SIZE);
             }
         }
 
-        // Сохранение состояния памяти в файл
-        void persist() {
-            File f = LittleFS.open(storageFile, "w");
-            if (f) {
-                f.write(ram, MEM_SIZE);
+        // Отметка изменённого диапазона (смещение от начала ram; сегмент данных — с MEM_SIZE)
+        void markDirty(uint32_t address, uint32_t length) {
+            if (length == 0 || address >= STORAGE_SIZE) return;
+            uint32_t first = address / STORAGE_PAGE_SIZE;
+            uint32_t last = min(address + length - 1, (uint32_t)STORAGE_SIZE - 1) / STORAGE_PAGE_SIZE;
+            dirty |= (uint32_t)((2ull << last) - (1ull << first));
+        }
+
+        // Отметка изменённого слова сегмента данных
+        void markDataWord(uint32_t index) {
+            dirty |= 1u << ((MEM_SIZE + index * 4) / STORAGE_PAGE_SIZE);
+        }
+
+        // Сохранение изменённых страниц в файл. Если файла нет или он неполный,
+        // записывается весь образ. Возвращает число записанных страниц, -1 — ошибка.
+        int32_t persist() {
+            if (dirty == 0) return 0;
+            File f = LittleFS.open(storageFile, "r+");
+            if (!f || f.size() != STORAGE_SIZE) {
+                if (f) f.close();
+                f = LittleFS.open(storageFile, "w");
+                if (!f || f.write(ram, STORAGE_SIZE) != STORAGE_SIZE) {
+                    Serial.println("Failed to persist state");
+                    return -1;
+                }
                 f.close();
-            } else {
-                Serial.println("Failed to persist state");
+                dirty = 0;
+                return STORAGE_PAGES;
+            }
+            int32_t written = 0;
+            for (uint32_t page = 0; page < STORAGE_PAGES; page++) {
+                if (!(dirty & (1u << page))) continue;
+                uint32_t offset = page * STORAGE_PAGE_SIZE;
+                if (!f.seek(offset) || f.write(ram + offset, STORAGE_PAGE_SIZE) != STORAGE_PAGE_SIZE) {
+                    Serial.println("Failed to persist state");
+                    f.close();
+                    return -1;
+                }
+                dirty &= ~(1u << page);
+                written++;
             }
+            f.close();
+            return written;
         }
 
-        // Восстановление состояния памяти из файла
+        // Восстановление состояния памяти из файла: при первом вызове весь образ,
+        // затем только страницы, изменённые после сохранения
         void restore() {
+            if (restored && dirty == 0) return;
             File f = LittleFS.open(storageFile, "r");
-            if (f) {
-                size_t readBytes = f.read(ram, MEM_SIZE);
-                if (readBytes != MEM_SIZE) {
-                    Serial.printf("Warning: Expected %d bytes, but read %d bytes\n", MEM_SIZE, readBytes);
+            if (!f) {
+                Serial.println("Failed to restore state");
+                return;
+            }
+            if (!restored) {
+                // Пустой файл — состояние ещё ни разу не сохранялось
+                size_t readBytes = f.read(ram, STORAGE_SIZE);
+                if (readBytes != STORAGE_SIZE && readBytes != 0) {
+                    Serial.printf("Warning: Expected %d bytes, but read %d bytes\n", STORAGE_SIZE, readBytes);
                 }
-                f.close();
+                restored = true;
             } else {
-                Serial.println("Failed to restore state");
+                for (uint32_t page = 0; page < STORAGE_PAGES; page++) {
+                    if (!(dirty & (1u << page))) continue;
+                    uint32_t offset = page * STORAGE_PAGE_SIZE;
+                    if (f.seek(offset)) f.read(ram + offset, STORAGE_PAGE_SIZE);
+                }
             }
+            dirty = 0;
+            f.close();
         }
     };
 
@@ -88,25 +331,138 @@ private:
     uint32_t sp = STACK_SIZE - 1;   // Указатель стека
     uint32_t stack[STACK_SIZE] = {0}; // Стек
     bool running = false;           // Флаг работы ВМ
+    uint32_t instrAddress = 0;      // Адрес исполняемой инструкции (для записи об ошибке)
+    bool segmented = false;         // Загружен образ с сегментами: STORE пишет в сегмент данных
+    uint32_t rodataEnd = 0;         // Граница rodata в сегменте данных (байт)
+    uint32_t programBytes = 0;      // Размер загруженного кода
+    VmFault lastFault = {};         // Первая ошибка последнего запуска
+    VmFaultPolicy faultPolicy = FAULT_POLICY_STOP;
+    uint32_t executed = 0;          // Количество выполненных инструкций с момента загрузки программы
+    uint32_t stopAt = UINT32_MAX;   // Значение executed, после которого run() возвращает управление
+    bool decodeEnabled = false;     // Исполнять программу через кэш декодированных блоков
+    bool fusionEnabled = true;      // Сливать соседние инструкции в суперинструкции
+
+    // Пул декодированных инструкций. Растёт по мере надобности до DECODE_POOL_MAX
+    // и переиспользуется между запусками.
+    DecodedInstr* decoded = nullptr;
+    uint16_t* decodedAddr = nullptr; // Адрес исходной инструкции в памяти
+    uint32_t decodedCount = 0;
+    uint32_t decodedCapacity = 0;
+
+    // Кэш базовых блоков
+    Block blocks[BLOCK_CACHE_SIZE];
+    uint32_t blockCount = 0;
+    int16_t blockHash[BLOCK_HASH_SIZE];
+    uint32_t cacheEpoch = 0;        // Увеличивается при каждом сбросе кэша
+    uint32_t codeLow = MEM_SIZE;    // Диапазон адресов, покрытый декодированными блоками
+    uint32_t codeHigh = 0;
 
     // Вспомогательные функции для чтения/записи 32-битных значений
     uint32_t read32(uint32_t address);
     void write32(uint32_t address, uint32_t value);
+    // Доступ к сегменту данных: одна проверка адреса и одно обращение к памяти
+    uint32_t loadWord(uint32_t address);
+    void storeWord(uint32_t address, uint32_t value);
 
     // Обработчик системных вызовов
     void handleSystemCall(uint8_t code);
 
+    // Запись ошибки; при политике STOP или фатальной ошибке останавливает ВМ.
+    // Вынесена из обработчиков, чтобы не раздувать горячий цикл.
+    VM_COLD void raiseFault(VmFaultCode code, uint32_t address, uint32_t operand, bool fatal = false);
+
+    // Проверка инструкции по адресу: опкод, номера регистров, адреса и границы
+    bool checkInstruction(uint32_t address) const;
+    // Поиск блока по адресу начала, при промахе — декодирование
+    // (-1 — адрес за концом памяти или нет памяти под пул)
+    int32_t enterBlock(uint32_t address);
+    int32_t findBlock(uint32_t address) const;
+    int32_t decodeBlock(uint32_t address);
+    // Декодирование статически достижимых от адреса 0 блоков при загрузке программы
+    void predecodeProgram();
+    bool reservePool(uint32_t count);
+    void flushBlocks();
+    // Замена соседних инструкций блока суперинструкциями
+    void fuseBlock(Block& blk);
+    // Отмечает изменение памяти; запись в декодированный код сбрасывает кэш блоков
+    void touchMemory(uint32_t address, uint32_t length);
+
+    // Разметка образа с сегментами после проверки заголовка
+    void applyImage(uint32_t codeSize, uint32_t rodataSize, uint32_t dataSize);
+    // Сброс pc, стека и кэша блоков после загрузки программы
+    void startProgram(bool predecode);
+
+    // Движки исполнения
+    // Интерпретация байткода напрямую из памяти; toBlockEnd — только до конца
+    // базового блока (возврат в декодированный движок после TRAP)
+    void runSwitch(bool toBlockEnd = false);
+    void runDecoded();   // Исполнение предекодированного массива
+    template <bool Profile> void runDecodedLoop();
+
+    OutputHandler outputHandler = nullptr; // nullptr — вывод в Serial
+    void* outputContext = nullptr;
+
+    // Профилирование (только для движка с декодированием)
+    VmProfile* profile = nullptr;
+    void profileStep(const DecodedInstr* ip);
+    void profileFinish();
+
     // Методы для работы со стеком
     bool push(uint32_t value);
     bool pop(uint32_t &value);
 
 public:
-    VirtualMachine();
+    // stateFile — файл, в котором сохраняется память ВМ (строка должна жить дольше ВМ)
+    explicit VirtualMachine(const char* stateFile = VM_STATE_FILE);
+    ~VirtualMachine();
+    VirtualMachine(const VirtualMachine&) = delete;
+    VirtualMachine& operator=(const VirtualMachine&) = delete;
+
     void reset();
-    void loadProgram(const uint8_t* program, size_t size);
-    void run();
-    void persistState();
+    // predecode = true: программа исполняется через кэш базовых блоков, каждый блок
+    // декодируется в инструкции фиксированной ширины один раз при первом входе.
+    // Принимает плоский байткод (обрезается до MEM_SIZE) или образ с сегментами;
+    // false — некорректный заголовок образа.
+    bool loadProgram(const uint8_t* program, size_t size, bool predecode = true);
+    // Загрузка программы из открытого файла прямо в память ВМ; false — программа
+    // не помещается в память или образ некорректен (память не тронута), либо ошибка
+    // чтения (память перечитывается из файла состояния, прежняя программа остаётся)
+    bool loadProgram(File& file, bool predecode = true);
+    // Размер кода последней загруженной программы
+    uint32_t programSize() const { return programBytes; }
+    // budget = 0 — до HALT или ошибки; иначе не больше примерно budget инструкций.
+    // Вызов, который оставил программу работающей, но не исполнил ни одной инструкции
+    // и не сдвинул pc, останавливает её с FAULT_NO_PROGRESS, поэтому циклы
+    // «пока isRunning()» у вызывающего кода всегда завершаются.
+    void run(uint32_t budget = 0);
+    // Программа не завершена: run() вернулся по исчерпанию бюджета
+    bool isRunning() const { return running; }
+    // Сохранение изменённых страниц памяти; возвращает число записанных страниц (-1 — ошибка)
+    int32_t persistState();
     void printState();
+    uint32_t instructionCount() const { return executed; }
+
+    // Слияние инструкций применяется к программам, загруженным после вызова
+    void setFusion(bool enabled) { fusionEnabled = enabled; }
+    // Самые частые последовательности из 2–3 опкодов в исполненных блоках
+    // (по убыванию числа исполнений); возвращает количество записей в out
+    uint32_t collectSequences(OpcodeSequence* out, uint32_t max) const;
+
+    // Профилировщик: счётчики по опкодам и адресам и циклы по опкодам.
+    // Включается до loadProgram(); пока он включён, слияние инструкций отключено,
+    // чтобы каждая исходная инструкция учитывалась отдельно.
+    bool setProfiling(bool enabled);
+    const VmProfile* profileData() const { return profile; }
+    // Перенаправление вывода программы (nullptr — в Serial)
+    void setOutputHandler(OutputHandler handler, void* context) {
+        outputHandler = handler;
+        outputContext = context;
+    }
+    // Ошибка последнего запуска (code == FAULT_NONE — ошибок не было)
+    const VmFault& fault() const { return lastFault; }
+    void setFaultPolicy(VmFaultPolicy policy) { faultPolicy = policy; }
+    // Байт памяти ВМ по адресу (для отчётов)
+    uint8_t peek(uint32_t address) const { return storage.read(address); }
 };
 
 #endif // VM_H
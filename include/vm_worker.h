@@ -0,0 +1,63 @@
+#ifndef VM_WORKER_H
+#define VM_WORKER_H
+
+#include <Arduino.h>
+
+// Исполнение фоновых программ ВМ в отдельной задаче: на ESP32 — задача FreeRTOS,
+// закреплённая за вторым ядром, на хосте — std::thread. Консоль и задача ВМ
+// обмениваются только через две очереди SPSC: запросы (bg/ps/kill) и сообщения
+// (ответы, отчёты о завершении, вывод программ). После workerStart() планировщиком
+// владеет задача ВМ, консоль к нему напрямую не обращается.
+// Флаг сборки -DVM_WORKER=0 оставляет исполнение в loop().
+#ifndef VM_WORKER
+#define VM_WORKER 1
+#endif
+
+// Ядро задачи ВМ: то, на котором не работает loop() (у Arduino loop() — на ядре 1)
+#ifndef WORKER_CORE
+#if defined(ARDUINO_RUNNING_CORE)
+#define WORKER_CORE          (ARDUINO_RUNNING_CORE ? 0 : 1)
+#else
+#define WORKER_CORE          0
+#endif
+#endif
+#define WORKER_STACK_SIZE    8192
+#define WORKER_PRIORITY      1
+// Через сколько тактов планировщика задача ВМ засыпает на один тик FreeRTOS:
+// taskYIELD() не отдаёт ядро задаче IDLE (приоритет 0), и без паузы
+// сторожевой таймер IDLE сработал бы на длинной фоновой программе
+#define WORKER_IDLE_TICKS    32
+#define WORKER_REQUESTS      8      // Ёмкость очереди запросов (степень двойки)
+#define WORKER_MESSAGES      32     // Ёмкость очереди сообщений (степень двойки)
+#define WORKER_MESSAGE_SIZE  96     // Байт текста в одном сообщении
+#define WORKER_REPLY_TIMEOUT 1000   // мс ожидания ответа на запрос
+
+enum WorkerRequestType : uint8_t {
+    WORKER_SPAWN,   // Запустить программу path
+    WORKER_KILL,    // Остановить программу id
+    WORKER_PS,      // Прислать таблицу программ
+};
+
+struct WorkerRequest {
+    WorkerRequestType type;
+    uint16_t id;
+    char path[64];
+    uint16_t sequence;  // Номер запроса, его проставляет workerCall()
+};
+
+struct WorkerMessage {
+    char text[WORKER_MESSAGE_SIZE];
+    uint16_t reply;     // Последнее сообщение ответа на запрос с этим номером (0 — не ответ)
+};
+
+// Запуск задачи ВМ; false — задачу создать не удалось (исполнение остаётся в loop())
+bool workerStart();
+bool workerActive();
+// Отправка запроса и вывод ответа через writeOutput (ждёт до WORKER_REPLY_TIMEOUT мс).
+// Опоздавший ответ на запрос, ожидание которого истекло, выводится, но ответом
+// на следующий запрос не считается
+bool workerCall(const WorkerRequest& request);
+// Вывод накопившихся сообщений (вызывается из loop() консоли)
+void workerDrain();
+
+#endif // VM_WORKER_H
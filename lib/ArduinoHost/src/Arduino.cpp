@@ -0,0 +1,95 @@
+#include "Arduino.h"
+#include <chrono>
+#include <thread>
+#include <cstdarg>
+#include <poll.h>
+#include <unistd.h>
+
+HostSerial Serial;
+HostESP ESP;
+
+static const auto bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+size_t HostSerial::print(const String& s) { return fwrite(s.c_str(), 1, s.length(), stdout); }
+size_t HostSerial::print(const char* s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+size_t HostSerial::print(char c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+size_t HostSerial::print(int v) { return ::printf("%d", v); }
+size_t HostSerial::print(unsigned int v) { return ::printf("%u", v); }
+size_t HostSerial::print(long v) { return ::printf("%ld", v); }
+size_t HostSerial::print(unsigned long v) { return ::printf("%lu", v); }
+size_t HostSerial::println() { return print('\n'); }
+size_t HostSerial::println(const String& s) { return print(s) + println(); }
+size_t HostSerial::println(const char* s) { return print(s) + println(); }
+
+size_t HostSerial::printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n < 0 ? 0 : n;
+}
+
+size_t HostSerial::write(const uint8_t* buf, size_t len) {
+    return fwrite(buf, 1, len, stdout);
+}
+
+int HostSerial::available() {
+    fflush(stdout);
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0 ? 1 : 0;
+}
+
+int HostSerial::read() {
+    return getchar();
+}
+
+String HostSerial::readStringUntil(char terminator) {
+    String result;
+    int c;
+    while ((c = getchar()) != EOF && c != terminator) {
+        result += static_cast<char>(c);
+    }
+    return result;
+}
+
+void HostSerial::flush() {
+    fflush(stdout);
+}
+
+void HostESP::restart() {
+    fflush(stdout);
+    exit(0);
+}
+
+void HostESP::deepSleep(uint64_t us) {
+    (void)us;
+    fflush(stdout);
+    exit(0);
+}
+
+uint32_t HostESP::getFreeHeap() {
+    return 0;
+}
+
+// Счётчик тактов процессора хоста (на x86 — TSC, иначе наносекунды)
+uint32_t HostESP::getCycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+    return static_cast<uint32_t>(__builtin_ia32_rdtsc());
+#else
+    return static_cast<uint32_t>(micros() * 1000);
+#endif
+}
@@ -0,0 +1,57 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Хостовая замена Arduino.h для env:native.
+// Реализует только то подмножество API ядра ESP32, которое использует проект.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include "WString.h"
+
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// Последовательный порт: вывод в stdout, ввод из stdin
+class HostSerial {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    size_t print(const String& s);
+    size_t print(const char* s);
+    size_t print(char c);
+    size_t print(int v);
+    size_t print(unsigned int v);
+    size_t print(long v);
+    size_t print(unsigned long v);
+    size_t println();
+    size_t println(const String& s);
+    size_t println(const char* s);
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+    size_t write(const uint8_t* buf, size_t len);
+    int available();
+    int read();
+    String readStringUntil(char terminator);
+    void flush();
+};
+
+// Системные функции платы
+class HostESP {
+public:
+    void restart();
+    void deepSleep(uint64_t us);
+    uint32_t getFreeHeap();
+    uint32_t getCycleCount();
+};
+
+extern HostSerial Serial;
+extern HostESP ESP;
+
+#endif
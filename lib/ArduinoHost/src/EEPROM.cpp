@@ -0,0 +1,38 @@
+#include "EEPROM.h"
+#include <cstdio>
+
+EEPROMClass EEPROM;
+
+static const char* eepromFile() {
+    const char* env = getenv("AIR_EEPROM_FILE");
+    return (env && *env) ? env : ".air_eeprom.bin";
+}
+
+bool EEPROMClass::begin(size_t size) {
+    // Как и на плате, «чистая» EEPROM заполнена 0xFF
+    data_.assign(size, 0xFF);
+    FILE* f = fopen(eepromFile(), "rb");
+    if (f) {
+        fread(data_.data(), 1, size, f);
+        fclose(f);
+    }
+    return true;
+}
+
+uint8_t EEPROMClass::read(int address) {
+    if (address < 0 || static_cast<size_t>(address) >= data_.size()) return 0;
+    return data_[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+    if (address < 0 || static_cast<size_t>(address) >= data_.size()) return;
+    data_[address] = value;
+}
+
+bool EEPROMClass::commit() {
+    FILE* f = fopen(eepromFile(), "wb");
+    if (!f) return false;
+    size_t written = fwrite(data_.data(), 1, data_.size(), f);
+    fclose(f);
+    return written == data_.size();
+}
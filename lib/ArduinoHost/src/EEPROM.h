@@ -0,0 +1,24 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+// Хостовая замена EEPROM: образ хранится в файле (по умолчанию ./.air_eeprom.bin,
+// переопределяется переменной окружения AIR_EEPROM_FILE).
+
+#include <vector>
+#include "Arduino.h"
+
+class EEPROMClass {
+public:
+    bool begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+    size_t length() const { return data_.size(); }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,252 @@
+#include "FS.h"
+#include "LittleFS.h"
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::FS LittleFS;
+
+namespace fs {
+
+// Раздел LittleFS по умолчанию на esp32dev (0x160000)
+static const size_t HOST_FS_TOTAL = 0x160000;
+
+struct File::Impl {
+    std::string vfsPath;
+    std::string baseName;
+    FILE* fp = nullptr;
+    DIR* dir = nullptr;
+
+    ~Impl() {
+        if (fp) fclose(fp);
+        if (dir) closedir(dir);
+    }
+};
+
+static std::string rootDir() {
+    const char* env = getenv("AIR_FS_ROOT");
+    return (env && *env) ? env : ".air_fs";
+}
+
+std::string FS::hostPath(const char* path) {
+    std::string p = path ? path : "";
+    if (p.empty() || p[0] != '/') p = "/" + p;
+    return rootDir() + p;
+}
+
+static std::string baseNameOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+File::operator bool() const {
+    return impl_ && (impl_->fp || impl_->dir);
+}
+
+void File::close() {
+    impl_.reset();
+}
+
+int File::available() {
+    if (!impl_ || !impl_->fp) return 0;
+    return static_cast<int>(size() - position());
+}
+
+int File::read() {
+    if (!impl_ || !impl_->fp) return -1;
+    return fgetc(impl_->fp);
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+    if (!impl_ || !impl_->fp) return 0;
+    return fread(buf, 1, size, impl_->fp);
+}
+
+int File::peek() {
+    if (!impl_ || !impl_->fp) return -1;
+    int c = fgetc(impl_->fp);
+    if (c != EOF) ungetc(c, impl_->fp);
+    return c;
+}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+    if (!impl_ || !impl_->fp) return 0;
+    return fwrite(buf, 1, size, impl_->fp);
+}
+
+size_t File::print(const String& s) {
+    return write(reinterpret_cast<const uint8_t*>(s.c_str()), s.length());
+}
+
+size_t File::print(const char* s) {
+    return write(reinterpret_cast<const uint8_t*>(s), strlen(s));
+}
+
+size_t File::println(const String& s) {
+    return print(s) + write('\n');
+}
+
+String File::readStringUntil(char terminator) {
+    String result;
+    int c;
+    while ((c = read()) != -1 && c != terminator) {
+        result += static_cast<char>(c);
+    }
+    return result;
+}
+
+void File::flush() {
+    if (impl_ && impl_->fp) fflush(impl_->fp);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    if (!impl_ || !impl_->fp) return false;
+    int whence = (mode == SeekCur) ? SEEK_CUR : (mode == SeekEnd) ? SEEK_END : SEEK_SET;
+    return fseek(impl_->fp, pos, whence) == 0;
+}
+
+size_t File::position() const {
+    if (!impl_ || !impl_->fp) return 0;
+    long pos = ftell(impl_->fp);
+    return pos < 0 ? 0 : static_cast<size_t>(pos);
+}
+
+size_t File::size() const {
+    if (!impl_ || !impl_->fp) return 0;
+    fflush(impl_->fp);
+    struct stat st;
+    if (fstat(fileno(impl_->fp), &st) != 0) return 0;
+    return static_cast<size_t>(st.st_size);
+}
+
+time_t File::getLastWrite() {
+    if (!impl_) return 0;
+    if (impl_->fp) fflush(impl_->fp);
+    struct stat st;
+    if (stat(FS::hostPath(impl_->vfsPath.c_str()).c_str(), &st) != 0) return 0;
+    return st.st_mtime;
+}
+
+const char* File::name() const {
+    return impl_ ? impl_->baseName.c_str() : "";
+}
+
+const char* File::path() const {
+    return impl_ ? impl_->vfsPath.c_str() : "";
+}
+
+bool File::isDirectory() const {
+    return impl_ && impl_->dir;
+}
+
+File File::openNextFile() {
+    if (!impl_ || !impl_->dir) return File();
+    struct dirent* entry;
+    while ((entry = readdir(impl_->dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        std::string child = impl_->vfsPath;
+        if (child.empty() || child.back() != '/') child += "/";
+        child += entry->d_name;
+        return LittleFS.open(child.c_str(), FILE_READ);
+    }
+    return File();
+}
+
+bool FS::begin(bool formatOnFail) {
+    (void)formatOnFail;
+    std::string root = rootDir();
+    struct stat st;
+    if (stat(root.c_str(), &st) == 0) return S_ISDIR(st.st_mode);
+    return ::mkdir(root.c_str(), 0755) == 0;
+}
+
+static void removeTree(const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        unlink(path.c_str());
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        removeTree(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+    ::rmdir(path.c_str());
+}
+
+bool FS::format() {
+    removeTree(rootDir());
+    return begin();
+}
+
+bool FS::exists(const char* path) {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+File FS::open(const char* path, const char* mode) {
+    File file;
+    std::string host = hostPath(path);
+    auto impl = std::make_shared<File::Impl>();
+    impl->vfsPath = path;
+    impl->baseName = baseNameOf(impl->vfsPath);
+
+    struct stat st;
+    if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->dir = opendir(host.c_str());
+    } else {
+        std::string m = mode;
+        if (m.find('b') == std::string::npos) m += "b";
+        impl->fp = fopen(host.c_str(), m.c_str());
+    }
+    if (impl->fp || impl->dir) file.impl_ = impl;
+    return file;
+}
+
+bool FS::remove(const char* path) {
+    return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::rmdir(const char* path) {
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+size_t FS::totalBytes() {
+    return HOST_FS_TOTAL;
+}
+
+static size_t treeSize(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    if (!S_ISDIR(st.st_mode)) return static_cast<size_t>(st.st_size);
+    size_t total = 0;
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        total += treeSize(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+    return total;
+}
+
+size_t FS::usedBytes() {
+    return treeSize(rootDir());
+}
+
+} // namespace fs
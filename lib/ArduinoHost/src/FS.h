@@ -0,0 +1,91 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+// Хостовая замена FS.h: файлы LittleFS отображаются на каталог хоста
+// (по умолчанию ./.air_fs, переопределяется переменной окружения AIR_FS_ROOT).
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File {
+public:
+    File() = default;
+
+    explicit operator bool() const;
+    void close();
+
+    int available();
+    int read();
+    size_t read(uint8_t* buf, size_t size);
+    int peek();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t size);
+    size_t print(const String& s);
+    size_t print(const char* s);
+    size_t println(const String& s);
+    String readStringUntil(char terminator);
+    void flush();
+
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    time_t getLastWrite();
+    const char* name() const;
+    const char* path() const;
+    bool isDirectory() const;
+    File openNextFile();
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl_;
+    friend class FS;
+};
+
+class FS {
+public:
+    bool begin(bool formatOnFail = false);
+    void end() {}
+    bool format();
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    File open(const char* path, const char* mode = FILE_READ);
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+    bool mkdir(const char* path);
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+    bool rmdir(const char* path);
+    bool rmdir(const String& path) { return rmdir(path.c_str()); }
+    size_t totalBytes();
+    size_t usedBytes();
+
+    // Путь на хосте для пути внутри ФС
+    static std::string hostPath(const char* path);
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
@@ -0,0 +1,75 @@
+#include "WString.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+
+String::String(int v) : s_(std::to_string(v)) {}
+String::String(unsigned int v) : s_(std::to_string(v)) {}
+String::String(long v) : s_(std::to_string(v)) {}
+String::String(unsigned long v) : s_(std::to_string(v)) {}
+String::String(long long v) : s_(std::to_string(v)) {}
+String::String(unsigned long long v) : s_(std::to_string(v)) {}
+
+String::String(double v, unsigned int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s_ = buf;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t pos = s_.find(c, from);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::indexOf(const String& str, unsigned int from) const {
+    size_t pos = s_.find(str.s_, from);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(char c) const {
+    size_t pos = s_.rfind(c);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(const String& str) const {
+    size_t pos = s_.rfind(str.s_);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+String String::substring(unsigned int from) const {
+    if (from >= s_.length()) return String();
+    return String(s_.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) { unsigned int t = from; from = to; to = t; }
+    if (from >= s_.length()) return String();
+    if (to > s_.length()) to = s_.length();
+    return String(s_.substr(from, to - from));
+}
+
+bool String::startsWith(const String& prefix) const {
+    return s_.compare(0, prefix.s_.length(), prefix.s_) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return s_.length() >= suffix.s_.length() &&
+           s_.compare(s_.length() - suffix.s_.length(), suffix.s_.length(), suffix.s_) == 0;
+}
+
+void String::trim() {
+    size_t begin = 0;
+    while (begin < s_.length() && isspace(static_cast<unsigned char>(s_[begin]))) begin++;
+    size_t end = s_.length();
+    while (end > begin && isspace(static_cast<unsigned char>(s_[end - 1]))) end--;
+    s_ = s_.substr(begin, end - begin);
+}
+
+long String::toInt() const {
+    return strtol(s_.c_str(), nullptr, 10);
+}
+
+String operator+(const String& lhs, const String& rhs) { String r(lhs); r += rhs; return r; }
+String operator+(const String& lhs, const char* rhs) { String r(lhs); r += rhs; return r; }
+String operator+(const char* lhs, const String& rhs) { String r(lhs); r += rhs; return r; }
+String operator+(const String& lhs, char rhs) { String r(lhs); r += rhs; return r; }
@@ -0,0 +1,62 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <string>
+#include <cstddef>
+
+// Подмножество Arduino String поверх std::string (только то, что использует проект)
+class String {
+public:
+    String() = default;
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    explicit String(char c) : s_(1, c) {}
+    String(int v);
+    String(unsigned int v);
+    String(long v);
+    String(unsigned long v);
+    String(long long v);
+    String(unsigned long long v);
+    String(double v, unsigned int decimals = 2);
+
+    unsigned int length() const { return s_.length(); }
+    const char* c_str() const { return s_.c_str(); }
+    char charAt(unsigned int i) const { return i < s_.length() ? s_[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    char& operator[](unsigned int i) { return s_[i]; }
+
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& str, unsigned int from = 0) const;
+    int lastIndexOf(char c) const;
+    int lastIndexOf(const String& str) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    bool startsWith(const String& prefix) const;
+    bool endsWith(const String& suffix) const;
+    void trim();
+    long toInt() const;
+    bool isEmpty() const { return s_.empty(); }
+    bool reserve(unsigned int size) { s_.reserve(size); return true; }
+
+    String& operator+=(const String& rhs) { s_ += rhs.s_; return *this; }
+    String& operator+=(const char* rhs) { s_ += rhs; return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+
+    bool operator==(const String& rhs) const { return s_ == rhs.s_; }
+    bool operator==(const char* rhs) const { return s_ == rhs; }
+    bool operator!=(const String& rhs) const { return s_ != rhs.s_; }
+    bool operator!=(const char* rhs) const { return s_ != rhs; }
+    bool operator<(const String& rhs) const { return s_ < rhs.s_; }
+
+    const std::string& str() const { return s_; }
+
+private:
+    std::string s_;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
+String operator+(const String& lhs, char rhs);
+
+#endif
@@ -2,14 +2,38 @@
 #include <FS.h>
 #include <EEPROM.h>
 #include <console.h>
+#include <commands/system.h>
+#include <commands/utils.h>
+#include <scheduler.h>
+#include <vm_worker.h>
+#include <output.h>
+#include <log.h>
 
 #define BAUDRATE 115200
 
 // =================== Основной скетч ===================
 void setup() {
+  uint32_t start = micros();
   Serial.begin(BAUDRATE);
+  bootRecord("serial", start);
   initializeFS();
+  // Дальше вывод консоли идёт через буфер и пишется в Serial фоновой задачей
+  start = micros();
+  if (!outputBegin()) {
+    Serial.println("Не удалось запустить задачу вывода, вывод будет синхронным");
+  }
+  bootRecord("output", start);
+  start = micros();
   printHelp();
+  bootRecord("help", start);
+#if VM_WORKER
+  // Фоновые программы ВМ исполняются на другом ядре; при неудаче — в loop()
+  if (!workerStart()) {
+    writeOutput("Не удалось запустить задачу ВМ, программы будут исполняться в loop()\n");
+  }
+#endif
+  bootFinished();
+  logMessage(LOG_INFO, "system", "загрузка за %lu мс", (unsigned long)millis());
 }
 
 void loop() {
@@ -17,7 +41,9 @@ void loop() {
     String input = Serial.readStringUntil('\n');
     input.trim();
     if (input.length() > 0) {
-      handleCommand(input);
+      handleCommand(input.c_str());
     }
   }
+  // Сообщения задачи ВМ или, без неё, срез фоновым программам между опросами консоли
+  serviceBackground();
 }
@@ -0,0 +1,783 @@
+#include "assembler.h"
+#include "vm.h"
+#include "peephole.h"
+#include <LittleFS.h>
+#include <ctype.h>
+#include <new>
+
+enum AsmSection : uint8_t {
+    SECTION_CODE,
+    SECTION_RODATA,
+    SECTION_DATA,
+    SECTION_COUNT
+};
+
+// Вид символа; метка секции s — SYMBOL_CODE + s
+enum AsmSymbolKind : uint8_t {
+    SYMBOL_CODE,
+    SYMBOL_RODATA,
+    SYMBOL_DATA,
+    SYMBOL_CONST,
+};
+
+struct AsmSymbol {
+    char name[ASM_SYMBOL_MAX];
+    uint32_t value;          // Для меток .data — смещение в секции (база известна после первого прохода)
+    uint32_t line;           // Строка определения (0 — встроенная константа)
+    uint8_t kind;
+};
+
+// Формат операндов инструкции
+enum OperandFormat : uint8_t {
+    FORMAT_NONE,             // halt
+    FORMAT_JUMP,             // jmp addr
+    FORMAT_REG,              // push r
+    FORMAT_REG_IMM,          // load r, imm32
+    FORMAT_REG_JUMP,         // jz r, addr
+    FORMAT_REG_MEM,          // store r, addr
+    FORMAT_REG_WORD,         // ldw r, addr (кратен 4)
+    FORMAT_REG3,             // add dst, src1, src2
+    FORMAT_CODE8,            // syscall code
+};
+
+struct Mnemonic {
+    const char* name;
+    uint8_t opcode;
+    uint8_t format;
+};
+
+static const Mnemonic mnemonics[] = {
+    {"halt",    OP_HALT,    FORMAT_NONE},
+    {"jmp",     OP_JMP,     FORMAT_JUMP},
+    {"call",    OP_CALL,    FORMAT_JUMP},
+    {"ret",     OP_RET,     FORMAT_NONE},
+    {"jz",      OP_JZ,      FORMAT_REG_JUMP},
+    {"jnz",     OP_JNZ,     FORMAT_REG_JUMP},
+    {"load",    OP_LOAD,    FORMAT_REG_IMM},
+    {"store",   OP_STORE,   FORMAT_REG_MEM},
+    {"ldw",     OP_LDW,     FORMAT_REG_WORD},
+    {"stw",     OP_STW,     FORMAT_REG_WORD},
+    {"add",     OP_ADD,     FORMAT_REG3},
+    {"sub",     OP_SUB,     FORMAT_REG3},
+    {"mul",     OP_MUL,     FORMAT_REG3},
+    {"div",     OP_DIV,     FORMAT_REG3},
+    {"cmp",     OP_CMP,     FORMAT_REG3},
+    {"push",    OP_PUSH,    FORMAT_REG},
+    {"pop",     OP_POP,     FORMAT_REG},
+    {"syscall", OP_SYSCALL, FORMAT_CODE8},
+};
+
+static const struct {
+    const char* name;
+    uint32_t value;
+} predefined[] = {
+    {"PRINT_STRING", 0x01},
+    {"LOAD_DATA",    0x02},
+    {"CHECKPOINT",   0x03},
+};
+
+#define PREDEFINED_COUNT  (sizeof(predefined) / sizeof(predefined[0]))
+#define ASM_READ_CHUNK    128
+#define ASM_WRITE_CHUNK   64
+
+enum ExprStatus : uint8_t {
+    EXPR_OK,
+    EXPR_UNKNOWN,            // Первый проход: символ ещё не определён
+    EXPR_ERROR,
+};
+
+struct Assembler {
+    fs::File source;
+    fs::File output;
+    AsmResult* result;
+    uint8_t pass;            // 1 — адреса меток и размеры, 2 — вывод
+    uint8_t section;
+    uint8_t emitSection;     // Второй проход выводит одну секцию за раз
+    bool image;              // Встретились .rodata или .data
+    bool created;            // Файл результата уже создан (при ошибке удаляется)
+    bool writeFailed;
+    bool optimize;           // Инструкции проходят через оконный оптимизатор (peephole.h)
+    bool exprLabel;          // Выражение зависит от метки или от константы, определённой ниже
+    uint32_t line;
+    uint32_t offset[SECTION_COUNT];
+    uint32_t size[SECTION_COUNT];   // Размеры после первого прохода (секции данных выровнены на 4)
+    uint16_t symbolCount;
+    AsmSymbol symbols[ASM_MAX_SYMBOLS];
+    PeepholeInstr window[PEEPHOLE_WINDOW];
+    uint8_t windowCount;
+    PeepholeStats stats;     // Считается на первом проходе
+    uint16_t readPos;
+    uint16_t readLength;
+    uint16_t writeLength;
+    uint8_t readBuffer[ASM_READ_CHUNK];
+    uint8_t writeBuffer[ASM_WRITE_CHUNK];
+};
+
+// ---- Ошибки ----
+
+static bool fail(Assembler& as, const char* message, const char* detail = nullptr) {
+    if (as.result->error[0] == 0) {
+        snprintf(as.result->error, sizeof(as.result->error), "%s%s", message, detail ? detail : "");
+        as.result->errorLine = as.line;
+    }
+    return false;
+}
+
+// ---- Разбор ----
+
+static inline void skipSpace(const char*& p) {
+    while (*p == ' ' || *p == '\t') p++;
+}
+
+static inline bool nameStart(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static inline bool nameChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static bool sameName(const char* a, const char* b) {
+    while (*a && tolower(static_cast<unsigned char>(*a)) == *b) {
+        a++;
+        b++;
+    }
+    return *a == 0 && *b == 0;
+}
+
+static bool readName(Assembler& as, const char*& p, char* name) {
+    skipSpace(p);
+    if (!nameStart(*p)) return fail(as, "ожидалось имя");
+    size_t length = 0;
+    while (nameChar(*p)) {
+        if (length + 1 >= ASM_SYMBOL_MAX) return fail(as, "слишком длинное имя");
+        name[length++] = *p++;
+    }
+    name[length] = 0;
+    return true;
+}
+
+static void skipComma(const char*& p) {
+    skipSpace(p);
+    if (*p == ',') p++;
+}
+
+static bool endOfLine(Assembler& as, const char* p) {
+    skipSpace(p);
+    return *p == 0 || fail(as, "лишние символы: ", p);
+}
+
+// Комментарий от ';' до конца строки; ';' в строках и символьных литералах не считается
+static void stripComment(char* text) {
+    for (char* p = text; *p; p++) {
+        if (*p == '"' || *p == '\'') {
+            char quote = *p;
+            while (p[1] && p[1] != quote) {
+                if (p[1] == '\\' && p[2]) p++;
+                p++;
+            }
+            if (p[1]) p++;
+        } else if (*p == ';') {
+            *p = 0;
+            return;
+        }
+    }
+}
+
+static bool readChar(Assembler& as, const char*& p, uint8_t& c) {
+    if (*p != '\\') {
+        c = static_cast<uint8_t>(*p++);
+        return true;
+    }
+    p++;
+    switch (*p) {
+        case 'n':  c = '\n'; break;
+        case 't':  c = '\t'; break;
+        case 'r':  c = '\r'; break;
+        case '0':  c = 0;    break;
+        case '\\': case '"': case '\'':
+            c = static_cast<uint8_t>(*p);
+            break;
+        default:
+            return fail(as, "неизвестная escape-последовательность");
+    }
+    p++;
+    return true;
+}
+
+static AsmSymbol* findSymbol(Assembler& as, const char* name) {
+    for (uint16_t i = 0; i < as.symbolCount; i++) {
+        if (strcmp(as.symbols[i].name, name) == 0) return &as.symbols[i];
+    }
+    return nullptr;
+}
+
+static ExprStatus evalExpr(Assembler& as, const char*& p, int64_t& value);
+
+static ExprStatus evalNumber(Assembler& as, const char*& p, int64_t& value) {
+    int base = 10;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    } else if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+        base = 2;
+        p += 2;
+    }
+    const char* start = p;
+    value = 0;
+    while (nameChar(*p)) {
+        char c = tolower(static_cast<unsigned char>(*p));
+        int digit = isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 99;
+        if (digit >= base) {
+            fail(as, "неверное число");
+            return EXPR_ERROR;
+        }
+        value = value * base + digit;
+        if (value > 0xFFFFFFFFLL) {
+            fail(as, "число больше 32 бит");
+            return EXPR_ERROR;
+        }
+        p++;
+    }
+    if (p == start) {
+        fail(as, "неверное число");
+        return EXPR_ERROR;
+    }
+    return EXPR_OK;
+}
+
+static ExprStatus evalPrimary(Assembler& as, const char*& p, int64_t& value) {
+    skipSpace(p);
+    if (*p == '-' || *p == '+') {
+        bool negate = *p++ == '-';
+        ExprStatus status = evalPrimary(as, p, value);
+        if (negate) value = -value;
+        return status;
+    }
+    if (*p == '(') {
+        p++;
+        ExprStatus status = evalExpr(as, p, value);
+        skipSpace(p);
+        if (status == EXPR_ERROR) return status;
+        if (*p != ')') {
+            fail(as, "ожидалась )");
+            return EXPR_ERROR;
+        }
+        p++;
+        return status;
+    }
+    if (isdigit(static_cast<unsigned char>(*p))) return evalNumber(as, p, value);
+    if (*p == '\'') {
+        p++;
+        uint8_t c;
+        if (*p == 0 || *p == '\'' || !readChar(as, p, c) || *p != '\'') {
+            fail(as, "неверный символьный литерал");
+            return EXPR_ERROR;
+        }
+        p++;
+        value = c;
+        return EXPR_OK;
+    }
+    char name[ASM_SYMBOL_MAX];
+    if (!nameStart(*p)) {
+        fail(as, "ожидалось выражение");
+        return EXPR_ERROR;
+    }
+    if (!readName(as, p, name)) return EXPR_ERROR;
+    AsmSymbol* symbol = findSymbol(as, name);
+    if (!symbol) {
+        as.exprLabel = true;
+        if (as.pass == 1) return EXPR_UNKNOWN;
+        fail(as, "неизвестный символ: ", name);
+        return EXPR_ERROR;
+    }
+    // Оптимизатор должен видеть одно и то же на обоих проходах: значения меток и констант,
+    // определённых ниже по тексту, на первом проходе неизвестны
+    if (symbol->kind != SYMBOL_CONST || symbol->line >= as.line) as.exprLabel = true;
+    if (symbol->kind == SYMBOL_DATA) {
+        // Метки .data идут после rodata, размер которой станет известен после первого прохода
+        if (as.pass == 1) return EXPR_UNKNOWN;
+        value = as.size[SECTION_RODATA] + symbol->value;
+    } else {
+        value = symbol->value;
+    }
+    return EXPR_OK;
+}
+
+static ExprStatus combine(ExprStatus a, ExprStatus b) {
+    return a == EXPR_ERROR || b == EXPR_ERROR ? EXPR_ERROR : (a == EXPR_UNKNOWN || b == EXPR_UNKNOWN ? EXPR_UNKNOWN : EXPR_OK);
+}
+
+static ExprStatus evalTerm(Assembler& as, const char*& p, int64_t& value) {
+    ExprStatus status = evalPrimary(as, p, value);
+    while (status != EXPR_ERROR) {
+        skipSpace(p);
+        char op = *p;
+        if (op != '*' && op != '/') break;
+        p++;
+        int64_t right;
+        status = combine(status, evalPrimary(as, p, right));
+        if (status != EXPR_OK) continue;
+        if (op == '*') {
+            value *= right;
+        } else if (right == 0) {
+            fail(as, "деление на ноль");
+            status = EXPR_ERROR;
+        } else {
+            value /= right;
+        }
+    }
+    return status;
+}
+
+static ExprStatus evalExpr(Assembler& as, const char*& p, int64_t& value) {
+    ExprStatus status = evalTerm(as, p, value);
+    while (status != EXPR_ERROR) {
+        skipSpace(p);
+        char op = *p;
+        if (op != '+' && op != '-') break;
+        p++;
+        int64_t right;
+        status = combine(status, evalTerm(as, p, right));
+        value = op == '+' ? value + right : value - right;
+    }
+    // Значение остаётся в пределах, которые можно проверить на 32 бита
+    if (status == EXPR_OK && (value > 0xFFFFFFFFLL || value < -0x80000000LL)) {
+        fail(as, "значение больше 32 бит");
+        return EXPR_ERROR;
+    }
+    return status;
+}
+
+// Выражение, значение которого должно быть известно уже на первом проходе (размеры, константы)
+static bool evalKnown(Assembler& as, const char*& p, int64_t& value) {
+    ExprStatus status = evalExpr(as, p, value);
+    if (status == EXPR_UNKNOWN) return fail(as, "значение должно быть известно до этой строки");
+    return status == EXPR_OK;
+}
+
+static bool readRegister(Assembler& as, const char*& p, uint8_t& reg) {
+    skipSpace(p);
+    if ((*p == 'r' || *p == 'R') && isdigit(static_cast<unsigned char>(p[1]))) {
+        const char* q = p + 1;
+        unsigned number = 0;
+        while (isdigit(static_cast<unsigned char>(*q)) && number < 256) number = number * 10 + (*q++ - '0');
+        if (!nameChar(*q)) {
+            if (number >= NUM_REGS) return fail(as, "нет такого регистра (r0..r7)");
+            reg = static_cast<uint8_t>(number);
+            p = q;
+            return true;
+        }
+    }
+    return fail(as, "ожидался регистр r0..r7");
+}
+
+// ---- Вывод ----
+
+static void flushOutput(Assembler& as) {
+    if (as.writeLength == 0) return;
+    if (as.output.write(as.writeBuffer, as.writeLength) != as.writeLength) as.writeFailed = true;
+    as.writeLength = 0;
+}
+
+static void emitByte(Assembler& as, uint8_t value) {
+    if (as.pass == 2 && as.section == as.emitSection) {
+        if (as.writeLength == sizeof(as.writeBuffer)) flushOutput(as);
+        as.writeBuffer[as.writeLength++] = value;
+    }
+    as.offset[as.section]++;
+}
+
+static void emitBigEndian(Assembler& as, uint32_t value) {
+    emitByte(as, value >> 24);
+    emitByte(as, value >> 16);
+    emitByte(as, value >> 8);
+    emitByte(as, value);
+}
+
+// Слово данных: в коде — как операнды (big-endian), в сегменте данных — как слово ВМ
+static void emitWord(Assembler& as, uint32_t value) {
+    if (as.section == SECTION_CODE) {
+        emitBigEndian(as, value);
+        return;
+    }
+    emitByte(as, value);
+    emitByte(as, value >> 8);
+    emitByte(as, value >> 16);
+    emitByte(as, value >> 24);
+}
+
+// ---- Символы ----
+
+static bool defineSymbol(Assembler& as, const char* name, uint8_t kind, uint32_t value) {
+    AsmSymbol* symbol = findSymbol(as, name);
+    if (as.pass == 2) {
+        // Второй проход видит те же определения; адрес метки обязан совпасть с первым проходом
+        if (symbol && symbol->kind == kind && (kind == SYMBOL_CONST || symbol->value == value)) return true;
+        return fail(as, "адрес метки изменился между проходами: ", name);
+    }
+    if (symbol) return fail(as, "символ уже определён: ", name);
+    if (as.symbolCount >= ASM_MAX_SYMBOLS) return fail(as, "слишком много символов");
+    symbol = &as.symbols[as.symbolCount++];
+    strcpy(symbol->name, name);
+    symbol->line = as.line;
+    symbol->kind = kind;
+    symbol->value = value;
+    return true;
+}
+
+static bool defineConstant(Assembler& as, const char* name, const char* p) {
+    int64_t value = 0;
+    if (as.pass == 1 && !evalKnown(as, p, value)) return false;
+    if (as.pass == 1 && !endOfLine(as, p)) return false;
+    return defineSymbol(as, name, SYMBOL_CONST, static_cast<uint32_t>(value));
+}
+
+// ---- Инструкции ----
+
+static bool checkOperand(Assembler& as, const Mnemonic& m, int64_t value) {
+    switch (m.format) {
+        case FORMAT_JUMP:
+        case FORMAT_REG_JUMP:
+            if (value < 0 || value >= as.size[SECTION_CODE]) return fail(as, "адрес перехода вне кода");
+            break;
+        case FORMAT_REG_MEM:
+            if (!as.image) {
+                if (value < 0 || value + 3 >= MEM_SIZE) return fail(as, "адрес вне памяти ВМ");
+                break;
+            }
+            // В образе с сегментами store пишет слово сегмента данных, как stw
+            // fall through
+        case FORMAT_REG_WORD:
+            if (value < 0 || value >= DATA_SIZE) return fail(as, "адрес вне сегмента данных");
+            if (value & 3) return fail(as, "адрес слова не кратен 4");
+            break;
+        case FORMAT_CODE8:
+            if (value < 0 || value > 0xFF) return fail(as, "номер вызова больше 255");
+            break;
+    }
+    return true;
+}
+
+static inline int registerCount(uint8_t format) {
+    return format == FORMAT_REG3 ? 3 :
+           (format == FORMAT_NONE || format == FORMAT_JUMP || format == FORMAT_CODE8) ? 0 : 1;
+}
+
+static inline bool hasValue(uint8_t format) {
+    return format != FORMAT_NONE && format != FORMAT_REG && format != FORMAT_REG3;
+}
+
+static void emitInstruction(Assembler& as, const PeepholeInstr& ins) {
+    uint8_t format = FORMAT_NONE;
+    for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++) {
+        if (mnemonics[i].opcode == ins.opcode) format = mnemonics[i].format;
+    }
+    emitByte(as, ins.opcode);
+    for (int i = 0; i < registerCount(format); i++) emitByte(as, ins.regs[i]);
+    if (format == FORMAT_CODE8) {
+        emitByte(as, static_cast<uint8_t>(ins.value));
+    } else if (hasValue(format)) {
+        emitBigEndian(as, ins.value);
+    }
+}
+
+// Вывод накопленного окна; окно заканчивается на метках, директивах и переходах
+static void flushWindow(Assembler& as) {
+    if (as.windowCount == 0) return;
+    PeepholeStats ignored = {};
+    size_t count = optimizeWindow(as.window, as.windowCount, as.pass == 1 ? as.stats : ignored);
+    for (size_t i = 0; i < count; i++) emitInstruction(as, as.window[i]);
+    as.windowCount = 0;
+}
+
+static bool assembleInstruction(Assembler& as, const Mnemonic& m, const char* p) {
+    if (as.section != SECTION_CODE) return fail(as, "инструкция вне секции .code: ", m.name);
+    PeepholeInstr ins = {m.opcode, {0, 0, 0}, 0, true};
+    int regCount = registerCount(m.format);
+    for (int i = 0; i < regCount; i++) {
+        if (i > 0) skipComma(p);
+        if (!readRegister(as, p, ins.regs[i])) return false;
+    }
+    if (hasValue(m.format)) {
+        if (regCount > 0) skipComma(p);
+        int64_t value = 0;
+        as.exprLabel = false;
+        ExprStatus status = evalExpr(as, p, value);
+        if (status == EXPR_ERROR) return false;
+        if (as.pass == 2 && !checkOperand(as, m, value)) return false;
+        ins.value = static_cast<uint32_t>(value);
+        ins.known = !as.exprLabel;
+    }
+    if (!endOfLine(as, p)) return false;
+
+    if (as.optimize && peepholeCandidate(ins.opcode)) {
+        as.window[as.windowCount++] = ins;
+        if (as.windowCount == PEEPHOLE_WINDOW) flushWindow(as);
+        return true;
+    }
+    flushWindow(as);
+    emitInstruction(as, ins);
+    return true;
+}
+
+// ---- Директивы ----
+
+static bool emitString(Assembler& as, const char*& p, bool terminate) {
+    skipSpace(p);
+    if (*p != '"') return fail(as, "ожидалась строка в кавычках");
+    p++;
+    while (*p && *p != '"') {
+        uint8_t c;
+        if (!readChar(as, p, c)) return false;
+        emitByte(as, c);
+    }
+    if (*p != '"') return fail(as, "незакрытая строка");
+    p++;
+    if (terminate) emitByte(as, 0);
+    return true;
+}
+
+// Список значений .byte/.word через запятую
+static bool emitValues(Assembler& as, const char* p, bool word) {
+    do {
+        int64_t value = 0;
+        ExprStatus status = evalExpr(as, p, value);
+        if (status == EXPR_ERROR) return false;
+        if (as.pass == 2 && !word && (value < -128 || value > 0xFF)) return fail(as, "значение не помещается в байт");
+        if (word) {
+            emitWord(as, static_cast<uint32_t>(value));
+        } else {
+            emitByte(as, static_cast<uint8_t>(value));
+        }
+        skipSpace(p);
+    } while (*p == ',' && p++);
+    return endOfLine(as, p);
+}
+
+static bool assembleDirective(Assembler& as, const char* p) {
+    char name[ASM_SYMBOL_MAX];
+    if (!readName(as, p, name)) return false;
+
+    if (sameName(name, "code") || sameName(name, "text")) {
+        as.section = SECTION_CODE;
+        return endOfLine(as, p);
+    }
+    if (sameName(name, "rodata") || sameName(name, "data")) {
+        as.section = sameName(name, "data") ? SECTION_DATA : SECTION_RODATA;
+        as.image = true;
+        return endOfLine(as, p);
+    }
+    if (sameName(name, "const") || sameName(name, "equ")) {
+        char symbol[ASM_SYMBOL_MAX];
+        if (!readName(as, p, symbol)) return false;
+        skipComma(p);
+        return defineConstant(as, symbol, p);
+    }
+    if (sameName(name, "byte")) return emitValues(as, p, false);
+    if (sameName(name, "word")) return emitValues(as, p, true);
+    if (sameName(name, "string") || sameName(name, "asciz") || sameName(name, "ascii")) {
+        if (!emitString(as, p, !sameName(name, "ascii"))) return false;
+        return endOfLine(as, p);
+    }
+    if (sameName(name, "space")) {
+        int64_t count, fill = 0;
+        if (!evalKnown(as, p, count)) return false;
+        skipSpace(p);
+        if (*p == ',') {
+            p++;
+            if (!evalKnown(as, p, fill)) return false;
+        }
+        if (!endOfLine(as, p)) return false;
+        if (count < 0 || count > MEM_SIZE + DATA_SIZE) return fail(as, "неверный размер .space");
+        for (int64_t i = 0; i < count; i++) emitByte(as, static_cast<uint8_t>(fill));
+        return true;
+    }
+    if (sameName(name, "align")) {
+        int64_t alignment;
+        if (!evalKnown(as, p, alignment) || !endOfLine(as, p)) return false;
+        if (alignment < 1 || alignment > 256 || (alignment & (alignment - 1))) {
+            return fail(as, "выравнивание — степень двойки до 256");
+        }
+        while (as.offset[as.section] & (alignment - 1)) emitByte(as, 0);
+        return true;
+    }
+    return fail(as, "неизвестная директива: .", name);
+}
+
+static bool assembleLine(Assembler& as, char* text) {
+    stripComment(text);
+    const char* p = text;
+    char name[ASM_SYMBOL_MAX];
+    while (true) {
+        skipSpace(p);
+        if (*p == 0) return true;
+        if (*p == '.') {
+            flushWindow(as);
+            return assembleDirective(as, p + 1);
+        }
+        if (!readName(as, p, name)) return false;
+        skipSpace(p);
+        if (*p == ':') {
+            p++;
+            flushWindow(as);
+            if (!defineSymbol(as, name, SYMBOL_CODE + as.section, as.offset[as.section])) return false;
+            continue;
+        }
+        if (*p == '=') return defineConstant(as, name, p + 1);
+        for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++) {
+            if (sameName(name, mnemonics[i].name)) return assembleInstruction(as, mnemonics[i], p);
+        }
+        return fail(as, "неизвестная инструкция: ", name);
+    }
+}
+
+// ---- Проходы ----
+
+// Строка исходника без '\r' и '\n'. 0 — конец файла, -1 — строка длиннее ASM_LINE_MAX
+static int readLine(Assembler& as, char* line) {
+    size_t length = 0;
+    bool any = false;
+    while (true) {
+        if (as.readPos == as.readLength) {
+            as.readLength = as.source.read(as.readBuffer, sizeof(as.readBuffer));
+            as.readPos = 0;
+            if (as.readLength == 0) break;
+        }
+        char c = static_cast<char>(as.readBuffer[as.readPos++]);
+        any = true;
+        if (c == '\n') break;
+        if (c == '\r') continue;
+        if (length + 1 >= ASM_LINE_MAX) return -1;
+        line[length++] = c;
+    }
+    line[length] = 0;
+    return any ? 1 : 0;
+}
+
+static bool runPass(Assembler& as, uint8_t pass, uint8_t emitSection) {
+    as.pass = pass;
+    as.emitSection = emitSection;
+    as.section = SECTION_CODE;
+    as.line = 0;
+    memset(as.offset, 0, sizeof(as.offset));
+    as.windowCount = 0;
+    as.source.seek(0);
+    as.readPos = as.readLength = 0;
+
+    char line[ASM_LINE_MAX];
+    int status;
+    while ((status = readLine(as, line)) > 0) {
+        as.line++;
+        if (!assembleLine(as, line)) return false;
+    }
+    as.line++;
+    if (status < 0) return fail(as, "слишком длинная строка");
+    flushWindow(as);
+    as.line = 0;
+    return true;
+}
+
+// Секция данных дополняется нулями до размера из первого прохода (кратного 4)
+static void padSection(Assembler& as, uint8_t section) {
+    as.section = section;
+    while (as.offset[section] < as.size[section]) emitByte(as, 0);
+}
+
+static bool writeImageHeader(Assembler& as) {
+    uint8_t header[IMAGE_HEADER_SIZE] = {};
+    memcpy(header, IMAGE_MAGIC, 4);
+    header[4] = IMAGE_VERSION;
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        header[8 + s * 2] = as.size[s] >> 8;
+        header[9 + s * 2] = as.size[s];
+    }
+    return as.output.write(header, sizeof(header)) == sizeof(header);
+}
+
+static bool writeMap(Assembler& as, const String& sourcePath, const String& mapPath) {
+    static const char* kinds[] = {"code", "rodata", "data", "const"};
+    fs::File map = LittleFS.open(mapPath, FILE_WRITE);
+    if (!map) return false;
+    String title = "; " + sourcePath + "\n";
+    bool ok = map.write(reinterpret_cast<const uint8_t*>(title.c_str()), title.length()) == title.length();
+    char line[ASM_SYMBOL_MAX + 24];
+    for (uint16_t i = PREDEFINED_COUNT; i < as.symbolCount && ok; i++) {
+        const AsmSymbol& symbol = as.symbols[i];
+        uint32_t value = symbol.kind == SYMBOL_DATA ? as.size[SECTION_RODATA] + symbol.value : symbol.value;
+        int length = snprintf(line, sizeof(line), "0x%04X %-6s %s\n", (unsigned)value, kinds[symbol.kind], symbol.name);
+        ok = map.write(reinterpret_cast<const uint8_t*>(line), length) == (size_t)length;
+    }
+    map.close();
+    return ok;
+}
+
+static bool assemble(Assembler& as, const String& sourcePath, const String& outputPath) {
+    for (size_t i = 0; i < PREDEFINED_COUNT; i++) {
+        defineSymbol(as, predefined[i].name, SYMBOL_CONST, predefined[i].value);
+    }
+    if (!runPass(as, 1, SECTION_CODE)) return false;
+
+    as.size[SECTION_CODE] = as.offset[SECTION_CODE];
+    as.size[SECTION_RODATA] = (as.offset[SECTION_RODATA] + 3) & ~3u;
+    as.size[SECTION_DATA] = (as.offset[SECTION_DATA] + 3) & ~3u;
+    if (as.size[SECTION_CODE] > MEM_SIZE) return fail(as, "код больше памяти ВМ");
+    if (as.size[SECTION_RODATA] + as.size[SECTION_DATA] > DATA_SIZE) return fail(as, "данные больше сегмента данных");
+
+    as.output = LittleFS.open(outputPath, FILE_WRITE);
+    if (!as.output) return fail(as, "ошибка создания файла: ", outputPath.c_str());
+    as.created = true;
+    if (as.image && !writeImageHeader(as)) return fail(as, "ошибка записи: ", outputPath.c_str());
+
+    // Второй проход по разу на секцию: в файле они идут подряд, код → rodata → data
+    for (uint8_t s = 0; s < (as.image ? SECTION_COUNT : 1); s++) {
+        if (!runPass(as, 2, s)) return false;
+        if (s != SECTION_CODE) padSection(as, s);
+    }
+    flushOutput(as);
+    as.output.close();
+    if (as.writeFailed) return fail(as, "ошибка записи: ", outputPath.c_str());
+    if (!writeMap(as, sourcePath, outputPath + ASM_MAP_SUFFIX)) {
+        return fail(as, "ошибка записи карты символов");
+    }
+    return true;
+}
+
+bool assembleFile(const String& sourcePath, const String& outputPath, bool optimize, AsmResult& result) {
+    memset(&result, 0, sizeof(result));
+    if (sourcePath == outputPath || sourcePath == outputPath + ASM_MAP_SUFFIX) {
+        snprintf(result.error, sizeof(result.error), "результат совпадает с исходником");
+        return false;
+    }
+    Assembler* as = new (std::nothrow) Assembler();
+    if (!as) {
+        snprintf(result.error, sizeof(result.error), "недостаточно памяти");
+        return false;
+    }
+    as->result = &result;
+    as->optimize = optimize;
+    as->source = LittleFS.open(sourcePath);
+    bool ok;
+    if (!as->source || as->source.isDirectory()) {
+        ok = fail(*as, "исходник не найден: ", sourcePath.c_str());
+    } else {
+        ok = assemble(*as, sourcePath, outputPath);
+    }
+    if (as->source) as->source.close();
+    if (as->output) as->output.close();
+
+    if (ok) {
+        result.codeSize = as->size[SECTION_CODE];
+        result.rodataSize = as->size[SECTION_RODATA];
+        result.dataSize = as->size[SECTION_DATA];
+        result.symbols = as->symbolCount - PREDEFINED_COUNT;
+        result.image = as->image;
+        result.optimized = as->stats;
+    } else if (as->created) {
+        // Недописанный результат не должен запускаться
+        LittleFS.remove(outputPath);
+        LittleFS.remove(outputPath + ASM_MAP_SUFFIX);
+    }
+    delete as;
+    return ok;
+}
@@ -1,29 +1,82 @@
 #include <Arduino.h>
 #include <EEPROM.h>
+#include <LittleFS.h>
+#include "console.h"
 #include "commands/utils.h"
 #include "commands/environment.h"
 
 EnvVar envVars[MAX_ENV_VARS];
 int envVarCount = 0;
 
-void handleSetEnv(String args) {
-    int spacePos = args.indexOf(' ');
-    if (spacePos == -1) {
+enum EnvRecordKind : uint8_t {
+    ENV_RECORD_SET   = 0x01,
+    ENV_RECORD_UNSET = 0x02,
+};
+
+#define ENV_RECORD_OVERHEAD  4   // Вид, две длины, контрольная сумма
+#define ENV_RECORD_MAX       (ENV_RECORD_OVERHEAD + 255 + 255)
+
+static uint8_t envIndex[ENV_HASH_SIZE];  // Номер в envVars + 1, 0 — свободный слот
+static size_t envFileLength = 0;         // Размер файла журнала (записи после снимка)
+
+static uint8_t envBatchDepth = 0;        // Вложенность envBegin
+static uint16_t envPending = 0;          // Изменений в открытом пакете
+static bool envBatchFailed = false;      // Внутренний пакет откачен — внешний не записывается
+
+// setenv <key> <value...> — слова значения соединяются пробелом
+void handleSetEnv(int argc, const char* argv[]) {
+    if (argc < 3) {
         writeOutput("Использование: setenv <key> <value>\n");
         return;
     }
-    String key = args.substring(0, spacePos);
-    String value = args.substring(spacePos + 1);
-    setEnvVar(key, value);
+    if (!setEnvVar(argv[1], joinArgs(argc, argv, 2))) {
+        writeOutput("Переменная не сохранена: нет места\n");
+        setCommandFailed();
+    }
+}
+
+void handleGetEnv(int argc, const char* argv[]) {
+    if (argc < 2) {
+        writeOutput("Использование: getenv <key>\n");
+        return;
+    }
+    const String* value = findEnvVar(argv[1], strlen(argv[1]));
+    if (value) writeOutput(value->c_str(), value->length());
+    writeOutput("\n", 1);
+}
+
+void handleUnsetEnv(int argc, const char* argv[]) {
+    if (argc < 2) {
+        writeOutput("Использование: unsetenv <key>\n");
+        return;
+    }
+    unsetEnvVar(argv[1]);
+}
+
+void handleEnvBegin() {
+    envBegin();
 }
 
-void handleGetEnv(String args) {
-    String value = getEnvVar(args);
-    writeOutput(value + "\n");
+void handleEnvCommit() {
+    if (!envInBatch()) {
+        writeOutput("Пакет не открыт (envbegin)\n");
+        return;
+    }
+    uint16_t pending = envPending;
+    if (envCommit()) {
+        if (!envInBatch()) writeOutput("Окружение сохранено, изменений: " + String(pending) + "\n");
+    } else {
+        writeOutput("Изменения окружения не сохранены\n");
+        setCommandFailed();
+    }
 }
 
-void handleUnsetEnv(String args) {
-    unsetEnvVar(args);
+void handleEnvRollback() {
+    if (!envInBatch()) {
+        writeOutput("Пакет не открыт (envbegin)\n");
+        return;
+    }
+    envRollback();
 }
 
 void handlePrintEnv() {
@@ -32,80 +85,306 @@ void handlePrintEnv() {
     }
 }
 
-String getEnvVar(const String& key) {
-    for (int i = 0; i < envVarCount; i++) {
-        if (envVars[i].key == key) return envVars[i].value;
+// ---- Индекс ----
+
+static uint32_t envHash(const char* key, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(key[i])) * 16777619u;
     }
-    return "";
+    return hash;
 }
 
-void setEnvVar(const String& key, const String& value) {
-    for (int i = 0; i < envVarCount; i++) {
-        if (envVars[i].key == key) {
-            envVars[i].value = value;
-            saveEnvVars();
-            return;
+// Номер переменной в envVars или -1
+static int findEnvIndex(const char* key, size_t length, uint32_t hash) {
+    for (size_t slot = hash & (ENV_HASH_SIZE - 1); envIndex[slot] != 0; slot = (slot + 1) & (ENV_HASH_SIZE - 1)) {
+        const EnvVar& var = envVars[envIndex[slot] - 1];
+        if (var.hash == hash && var.key.length() == length && memcmp(var.key.c_str(), key, length) == 0) {
+            return envIndex[slot] - 1;
         }
     }
+    return -1;
+}
 
-    if (envVarCount < MAX_ENV_VARS) {
-        envVars[envVarCount++] = {key, value};
-        saveEnvVars();
+static void indexEnvVar(int index) {
+    size_t slot = envVars[index].hash & (ENV_HASH_SIZE - 1);
+    while (envIndex[slot] != 0) slot = (slot + 1) & (ENV_HASH_SIZE - 1);
+    envIndex[slot] = index + 1;
+}
+
+static void rebuildEnvIndex() {
+    memset(envIndex, 0, sizeof(envIndex));
+    for (int i = 0; i < envVarCount; i++) indexEnvVar(i);
+}
+
+// Изменение таблицы в памяти, без записи в EEPROM
+static bool putEnvVar(const String& key, const String& value) {
+    uint32_t hash = envHash(key.c_str(), key.length());
+    int index = findEnvIndex(key.c_str(), key.length(), hash);
+    if (index >= 0) {
+        envVars[index].value = value;
+        return true;
     }
+    if (envVarCount >= MAX_ENV_VARS) return false;
+    envVars[envVarCount] = {key, value, hash};
+    indexEnvVar(envVarCount++);
+    return true;
 }
 
-void unsetEnvVar(const String& key) {
+static bool removeEnvVar(const String& key) {
+    int index = findEnvIndex(key.c_str(), key.length(), envHash(key.c_str(), key.length()));
+    if (index < 0) return false;
+    // Порядок переменных (printenv) сохраняется, индекс пересобирается: unsetenv редок
+    for (int j = index; j < envVarCount - 1; j++) {
+        envVars[j] = envVars[j + 1];
+    }
+    envVars[--envVarCount] = EnvVar();
+    rebuildEnvIndex();
+    return true;
+}
+
+// ---- Журнал: снимок в EEPROM и дописываемый файл ----
+
+static size_t recordLength(const String& key, const String& value) {
+    return ENV_RECORD_OVERHEAD + key.length() + value.length();
+}
+
+// Размер снимка в EEPROM (заголовок и по записи на переменную)
+static size_t compactLength() {
+    size_t length = ENV_LOG_START;
+    for (int i = 0; i < envVarCount; i++) length += recordLength(envVars[i].key, envVars[i].value);
+    return length;
+}
+
+static uint8_t recordChecksum(uint8_t kind, const char* key, size_t keyLength,
+                              const char* value, size_t valueLength) {
+    uint32_t hash = envHash(key, keyLength);
+    hash = (hash ^ kind) * 16777619u;
+    hash = (hash ^ envHash(value, valueLength)) * 16777619u;
+    return static_cast<uint8_t>(hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24));
+}
+
+// Запись в буфер; длины ключа и значения не больше 255 (проверяет setEnvVar и перенос
+// старого формата). Результат — длина записи
+static size_t encodeRecord(uint8_t* out, uint8_t kind, const String& key, const String& value) {
+    size_t pos = 0;
+    out[pos++] = kind;
+    out[pos++] = key.length();
+    out[pos++] = value.length();
+    memcpy(out + pos, key.c_str(), key.length());
+    pos += key.length();
+    memcpy(out + pos, value.c_str(), value.length());
+    pos += value.length();
+    out[pos++] = recordChecksum(kind, key.c_str(), key.length(), value.c_str(), value.length());
+    return pos;
+}
+
+// Длина записи по её первым трём байтам (0 — неизвестный вид: конец журнала)
+static size_t decodedLength(const uint8_t* header) {
+    if (header[0] != ENV_RECORD_SET && header[0] != ENV_RECORD_UNSET) return 0;
+    return ENV_RECORD_OVERHEAD + header[1] + header[2];
+}
+
+// Проверка и применение целой записи; false — запись испорчена (недописана при сбое питания)
+static bool applyRecord(const uint8_t* record) {
+    const char* key = reinterpret_cast<const char*>(record + 3);
+    const char* value = key + record[1];
+    if (record[3 + record[1] + record[2]] != recordChecksum(record[0], key, record[1], value, record[2])) {
+        return false;
+    }
+    String keyText, valueText;
+    keyText.reserve(record[1]);
+    valueText.reserve(record[2]);
+    for (size_t i = 0; i < record[1]; i++) keyText += key[i];
+    for (size_t i = 0; i < record[2]; i++) valueText += value[i];
+    if (record[0] == ENV_RECORD_SET) {
+        putEnvVar(keyText, valueText);
+    } else {
+        removeEnvVar(keyText);
+    }
+    return true;
+}
+
+// Изменение дописывается в файл журнала: LittleFS дописывает только хвост файла, а
+// EEPROM.commit() на ESP32 переписывает весь образ в NVS. Когда файл дорастает до
+// ENV_LOG_FILE_MAX или ФС недоступна, журнал сжимается в снимок EEPROM (saveEnvVars).
+// Таблица в памяти к этому моменту уже содержит изменение. В пакете запись
+// откладывается до envCommit
+static bool appendRecord(uint8_t kind, const String& key, const String& value) {
+    if (envBatchDepth > 0) {
+        envPending++;
+        return true;
+    }
+    uint8_t record[ENV_RECORD_MAX];
+    size_t length = encodeRecord(record, kind, key, value);
+    if (envFileLength + length > ENV_LOG_FILE_MAX) return saveEnvVars();
+    fs::File file = LittleFS.open(ENV_LOG_FILE, FILE_APPEND);
+    if (!file) return saveEnvVars();
+    size_t written = file.write(record, length);
+    file.close();
+    if (written != length) return saveEnvVars();
+    envFileLength += length;
+    return true;
+}
+
+// Снимок пишется в EEPROM одним commit, после чего файл журнала больше не нужен.
+// Если удалить файл не удалось, при загрузке его записи проиграются поверх снимка
+// и дадут то же состояние
+bool saveEnvVars() {
+    if (compactLength() > EEPROM_SIZE) return false;
+    for (size_t i = 0; i < ENV_LOG_START; i++) EEPROM.write(i, ENV_LOG_MAGIC[i]);
+    uint8_t record[ENV_RECORD_MAX];
+    size_t pos = ENV_LOG_START;
     for (int i = 0; i < envVarCount; i++) {
-        if (envVars[i].key == key) {
-            for (int j = i; j < envVarCount - 1; j++) {
-                envVars[j] = envVars[j + 1];
-            }
-            envVarCount--;
-            saveEnvVars();
-            return;
-        }
+        size_t length = encodeRecord(record, ENV_RECORD_SET, envVars[i].key, envVars[i].value);
+        for (size_t j = 0; j < length; j++) EEPROM.write(pos++, record[j]);
     }
+    if (pos < EEPROM_SIZE) EEPROM.write(pos, 0);
+    if (!EEPROM.commit()) return false;
+    if (envFileLength > 0 || LittleFS.exists(ENV_LOG_FILE)) LittleFS.remove(ENV_LOG_FILE);
+    envFileLength = 0;
+    return true;
 }
 
-void loadEnvVars() {
+// Старый формат: строка key=value;key=value; с нулём в конце
+static void loadLegacyEnvVars() {
     String envData;
     for (int i = 0; i < EEPROM_SIZE; i++) {
         char c = EEPROM.read(i);
-        if (c == 0) break;
+        if (c == 0 || c == (char)0xFF) break;
         envData += c;
     }
 
     int pos = 0;
-    while (pos < envData.length()) {
+    while (pos < (int)envData.length()) {
         int eqPos = envData.indexOf('=', pos);
         if (eqPos == -1) break;
         
         int endPos = envData.indexOf(';', eqPos);
         if (endPos == -1) endPos = envData.length();
 
-        String key = envData.substring(pos, eqPos);
-        String value = envData.substring(eqPos + 1, endPos);
-        
-        if (envVarCount < MAX_ENV_VARS) {
-            envVars[envVarCount++] = {key, value};
+        // Длины в записи журнала — по байту: такие переменные не переносятся
+        if (eqPos > pos && eqPos - pos <= 255 && endPos - eqPos - 1 <= 255) {
+            putEnvVar(envData.substring(pos, eqPos), envData.substring(eqPos + 1, endPos));
         }
         pos = endPos + 1;
     }
 }
 
-void saveEnvVars() {
-    String envData;
-    for (int i = 0; i < envVarCount; i++) {
-        envData += envVars[i].key + "=" + envVars[i].value + ";";
-        if (envData.length() > EEPROM_SIZE - 2) break;
+static bool hasLogMagic() {
+    for (size_t i = 0; i < ENV_LOG_START; i++) {
+        if (EEPROM.read(i) != static_cast<uint8_t>(ENV_LOG_MAGIC[i])) return false;
     }
+    return true;
+}
 
-    for (int i = 0; i < EEPROM_SIZE; i++) {
-        if (i < envData.length()) {
-            EEPROM.write(i, envData[i]);
-        } else {
-            EEPROM.write(i, 0);
-        }
+// Записи файла журнала поверх снимка; испорченный хвост отбрасывается при следующем сжатии
+static void replayLogFile() {
+    envFileLength = 0;
+    fs::File file = LittleFS.open(ENV_LOG_FILE, FILE_READ);
+    if (!file) return;
+    uint8_t record[ENV_RECORD_MAX];
+    size_t length;
+    while (file.read(record, 3) == 3 && (length = decodedLength(record)) != 0 &&
+           file.read(record + 3, length - 3) == length - 3 && applyRecord(record)) {
+        envFileLength += length;
+    }
+    bool truncated = envFileLength != file.size();
+    file.close();
+    if (truncated) saveEnvVars();
+}
+
+void loadEnvVars() {
+    envVarCount = 0;
+    rebuildEnvIndex();
+    if (!hasLogMagic()) {
+        // Первая загрузка после обновления: переменные переносятся в журнал один раз
+        loadLegacyEnvVars();
+        saveEnvVars();
+        return;
+    }
+
+    // Снимок может содержать и записи UNSET: до появления файла журнал дописывался в EEPROM
+    uint8_t record[ENV_RECORD_MAX];
+    size_t pos = ENV_LOG_START;
+    while (pos + ENV_RECORD_OVERHEAD <= EEPROM_SIZE) {
+        for (size_t i = 0; i < 3; i++) record[i] = EEPROM.read(pos + i);
+        size_t length = decodedLength(record);
+        if (length == 0 || pos + length > EEPROM_SIZE) break;
+        for (size_t i = 3; i < length; i++) record[i] = EEPROM.read(pos + i);
+        if (!applyRecord(record)) break;
+        pos += length;
+    }
+    replayLogFile();
+}
+
+// ---- Пакеты ----
+
+void envBegin() {
+    if (envBatchDepth == 0) {
+        envPending = 0;
+        envBatchFailed = false;
     }
-    EEPROM.commit();
-}
\ No newline at end of file
+    envBatchDepth++;
+}
+
+bool envInBatch() {
+    return envBatchDepth > 0;
+}
+
+static void discardBatch() {
+    envBatchDepth = 0;
+    envPending = 0;
+    envBatchFailed = false;
+    loadEnvVars();
+}
+
+bool envCommit() {
+    if (envBatchDepth == 0) return true;
+    if (--envBatchDepth > 0) return !envBatchFailed;
+    if (envBatchFailed) {
+        discardBatch();
+        return false;
+    }
+    bool ok = envPending == 0 || saveEnvVars();
+    envPending = 0;
+    if (!ok) loadEnvVars();
+    return ok;
+}
+
+void envRollback() {
+    if (envBatchDepth == 0) return;
+    if (envBatchDepth > 1) {
+        envBatchDepth--;
+        envBatchFailed = true;
+        return;
+    }
+    discardBatch();
+}
+
+String getEnvVar(const String& key) {
+    const String* value = findEnvVar(key.c_str(), key.length());
+    return value ? *value : String("");
+}
+
+const String* findEnvVar(const char* key, size_t length) {
+    int index = findEnvIndex(key, length, envHash(key, length));
+    return index >= 0 ? &envVars[index].value : nullptr;
+}
+
+bool setEnvVar(const String& key, const String& value) {
+    // Длины в записи — по байту; после сжатия журнал должен поместиться в EEPROM
+    if (key.length() == 0 || key.length() > 255 || value.length() > 255) return false;
+    const String* old = findEnvVar(key.c_str(), key.length());
+    if (old && *old == value) return true;
+    size_t oldLength = old ? recordLength(key, *old) : 0;
+    if (compactLength() - oldLength + recordLength(key, value) > EEPROM_SIZE) return false;
+    if (!putEnvVar(key, value)) return false;
+    return appendRecord(ENV_RECORD_SET, key, value);
+}
+
+void unsetEnvVar(const String& key) {
+    if (removeEnvVar(key)) {
+        appendRecord(ENV_RECORD_UNSET, key, String(""));
+    }
+}
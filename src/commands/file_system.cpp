@@ -140,16 +140,21 @@ void changeDir(const String &path) {
   if (dir) { dir.close(); }
 }
 
-// Копирование файла.
-// Параметр args должен содержать два пути, разделённых пробелом: "<источник> <назначение>"
-void copyFile(const String &args) {
-  int spacePos = args.indexOf(' ');
-  if (spacePos == -1) {
-    writeOutput("Неверный формат команды копирования. Используйте: copy <источник> <назначение>\n");
-    return;
-  }
-  String sourcePath = normalizePath(args.substring(0, spacePos));
-  String destPath   = normalizePath(args.substring(spacePos + 1));
+struct CopyTarget {
+  fs::File* dest;
+  bool* written;
+};
+
+static bool copySink(const char* data, size_t length, void* context) {
+  CopyTarget& target = *static_cast<CopyTarget*>(context);
+  *target.written = target.dest->write(reinterpret_cast<const uint8_t*>(data), length) == length;
+  return *target.written;
+}
+
+// Копирование файла
+void copyFile(const String &sourceName, const String &destName) {
+  String sourcePath = normalizePath(sourceName);
+  String destPath   = normalizePath(destName);
 
   fs::File source = LittleFS.open(sourcePath, FILE_READ);
   if (!source) {
@@ -163,30 +168,27 @@ void copyFile(const String &args) {
     return;
   }
 
-  const size_t bufSize = 512;
-  uint8_t buffer[bufSize];
-  while (source.available()) {
-    size_t bytesRead = source.read(buffer, bufSize);
-    dest.write(buffer, bytesRead);
-  }
+  bool written = true;
+  CopyTarget target = {&dest, &written};
+  streamFile(source, copySink, &target);
   source.close();
   dest.close();
+  if (!written) {
+    // Недописанная копия удаляется: mv не должен удалить исходный файл
+    LittleFS.remove(destPath);
+    writeOutput("Ошибка записи: " + destPath + "\n");
+    return;
+  }
   writeOutput("Файл скопирован: " + sourcePath + " -> " + destPath + "\n");
 }
 
 // Перемещение файла (копирование + удаление исходного файла)
-// Параметр args: "<источник> <назначение>"
-void moveFile(const String &args) {
-  int spacePos = args.indexOf(' ');
-  if (spacePos == -1) {
-    writeOutput("Неверный формат команды перемещения. Используйте: move <источник> <назначение>\n");
-    return;
-  }
-  String sourcePath = normalizePath(args.substring(0, spacePos));
-  String destPath   = normalizePath(args.substring(spacePos + 1));
+void moveFile(const String &sourceName, const String &destName) {
+  String sourcePath = normalizePath(sourceName);
+  String destPath   = normalizePath(destName);
 
   // Сначала копируем файл
-  copyFile(args);
+  copyFile(sourceName, destName);
 
   // Если файл назначения создан, удаляем исходный файл
   fs::File destCheck = LittleFS.open(destPath, FILE_READ);
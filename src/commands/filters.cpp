@@ -0,0 +1,304 @@
+#include "commands/filters.h"
+#include "commands/utils.h"
+#include "output.h"
+#include "tokenizer.h"
+#include <LittleFS.h>
+#include <new>
+
+// ---- Фильтры ----
+
+// grep [-v] [-i] [-c] <образец>: строки, содержащие образец (подстрока)
+class GrepFilter : public LineFilter {
+public:
+    const char* pattern = "";   // Указывает в буфер разобранной строки, живущий дольше фильтра
+    bool invert = false;
+    bool ignoreCase = false;
+    bool countOnly = false;
+
+    void finish() override {
+        LineFilter::finish();
+        if (countOnly) {
+            String text = String(matches) + "\n";
+            emit(text.c_str(), text.length());
+        }
+    }
+
+protected:
+    void line(const char* text, size_t length) override {
+        if (contains(text, length) == invert) return;
+        matches++;
+        if (!countOnly) emit(text, length);
+    }
+
+private:
+    uint32_t matches = 0;
+
+    bool contains(const char* text, size_t length) const {
+        size_t n = strlen(pattern);
+        const char* p = pattern;
+        if (n == 0) return true;
+        for (size_t i = 0; i + n <= length; i++) {
+            size_t k = 0;
+            while (k < n && same(text[i + k], p[k])) k++;
+            if (k == n) return true;
+        }
+        return false;
+    }
+
+    bool same(char a, char b) const {
+        return ignoreCase ? tolower((unsigned char)a) == tolower((unsigned char)b) : a == b;
+    }
+};
+
+// head [-n] N: первые N строк; после них источник может прекратить чтение
+class HeadFilter : public LineFilter {
+public:
+    uint32_t limit = FILTER_DEFAULT_LINES;
+
+    bool closed() const override {
+        return printed >= limit || LineFilter::closed();
+    }
+
+protected:
+    void line(const char* text, size_t length) override {
+        if (printed >= limit) return;
+        emit(text, length);
+        // Строка, разрезанная по PIPE_LINE_MAX, считается одной
+        if (text[length - 1] == '\n') printed++;
+    }
+
+private:
+    uint32_t printed = 0;
+};
+
+// tail [-n] N: последние N строк из хвоста потока длиной до TAIL_BUFFER_SIZE байт
+class TailFilter : public PipeFilter {
+public:
+    uint32_t limit = FILTER_DEFAULT_LINES;
+
+    void write(const char* data, size_t length) override {
+        total += length;
+        // Из порции, длиннее буфера, нужен только её конец
+        if (length > sizeof(ring)) {
+            data += length - sizeof(ring);
+            length = sizeof(ring);
+        }
+        while (length > 0) {
+            size_t offset = head % sizeof(ring);
+            size_t chunk = min(length, sizeof(ring) - offset);
+            memcpy(ring + offset, data, chunk);
+            head += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    void finish() override {
+        if (limit == 0) return;
+        size_t stored = min<size_t>(total, sizeof(ring));
+        size_t start = head - stored;
+        // Назад от конца до limit-го перевода строки (завершающий '\n' не считается)
+        size_t pos = head;
+        uint32_t lines = 0;
+        if (pos > start && at(pos - 1) == '\n') pos--;
+        while (pos > start) {
+            if (at(pos - 1) == '\n' && ++lines == limit) break;
+            pos--;
+        }
+        // Хвост начался посреди строки, вытесненной из буфера: её обрывок не выводится
+        if (pos == start && total > stored) {
+            while (pos < head && at(pos) != '\n') pos++;
+            if (pos < head) pos++;
+        }
+        while (pos < head) {
+            size_t offset = pos % sizeof(ring);
+            size_t chunk = min(head - pos, sizeof(ring) - offset);
+            emit(ring + offset, chunk);
+            pos += chunk;
+        }
+    }
+
+private:
+    char ring[TAIL_BUFFER_SIZE];
+    size_t head = 0;     // Всего записано в кольцо (позиция следующего байта)
+    size_t total = 0;    // Всего байт во входном потоке
+
+    char at(size_t pos) const { return ring[pos % sizeof(ring)]; }
+};
+
+// wc: число строк, слов и байт
+class WcFilter : public PipeFilter {
+public:
+    void write(const char* data, size_t length) override {
+        bytes += length;
+        for (size_t i = 0; i < length; i++) {
+            char c = data[i];
+            if (c == '\n') lines++;
+            bool blank = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            if (!blank && !inWord) words++;
+            inWord = !blank;
+        }
+    }
+
+    void finish() override {
+        String text = String(lines) + " " + String(words) + " " + String(bytes) + "\n";
+        emit(text.c_str(), text.length());
+    }
+
+private:
+    uint32_t lines = 0, words = 0, bytes = 0;
+    bool inWord = false;
+};
+
+// ---- Разбор аргументов ----
+
+static PipeFilter* noMemory(const char* name) {
+    writeOutput("Недостаточно памяти для " + String(name) + "\n");
+    return nullptr;
+}
+
+static bool isNumber(const char* text) {
+    if (!*text) return false;
+    for (; *text; text++) {
+        if (!isdigit((unsigned char)*text)) return false;
+    }
+    return true;
+}
+
+// [-n N | -N | N] [file] для head и tail; false — ошибка в аргументах
+static bool parseLineCount(int argc, const char* argv[], uint32_t& limit, int& fileArg) {
+    bool counted = false;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-n") == 0 && i + 1 < argc && isNumber(argv[i + 1])) {
+            limit = atol(argv[++i]);
+            counted = true;
+        } else if (arg[0] == '-' && isNumber(arg + 1)) {
+            limit = atol(arg + 1);
+            counted = true;
+        } else if (!counted && !fileArg && isNumber(arg)) {
+            limit = atol(arg);
+            counted = true;
+        } else if (!fileArg && arg[0] != '-') {
+            fileArg = i;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static PipeFilter* createGrep(int argc, const char* argv[], int& fileArg) {
+    GrepFilter* grep = new (std::nothrow) GrepFilter();
+    if (!grep) return noMemory(argv[0]);
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "-v") == 0) grep->invert = true;
+        else if (strcmp(argv[i], "-i") == 0) grep->ignoreCase = true;
+        else if (strcmp(argv[i], "-c") == 0) grep->countOnly = true;
+        else break;
+    }
+    if (i >= argc || argc - i > 2) {
+        delete grep;
+        writeOutput("Использование: grep [-v] [-i] [-c] <образец> [file]\n");
+        return nullptr;
+    }
+    grep->pattern = argv[i];
+    if (i + 1 < argc) fileArg = i + 1;
+    return grep;
+}
+
+template <typename Filter>
+static PipeFilter* createLineCount(int argc, const char* argv[], int& fileArg, const char* usage) {
+    Filter* filter = new (std::nothrow) Filter();
+    if (!filter) return noMemory(argv[0]);
+    if (!parseLineCount(argc, argv, filter->limit, fileArg)) {
+        delete filter;
+        writeOutput(usage);
+        return nullptr;
+    }
+    return filter;
+}
+
+PipeFilter* createFilter(int argc, const char* argv[], int& fileArg) {
+    fileArg = 0;
+    PipeFilter* filter = nullptr;
+    const char* name = argv[0];
+    if (strcmp(name, "grep") == 0) {
+        return createGrep(argc, argv, fileArg);
+    } else if (strcmp(name, "head") == 0) {
+        return createLineCount<HeadFilter>(argc, argv, fileArg, "Использование: head [-n N] [file]\n");
+    } else if (strcmp(name, "tail") == 0) {
+        return createLineCount<TailFilter>(argc, argv, fileArg, "Использование: tail [-n N] [file]\n");
+    } else if (strcmp(name, "wc") == 0) {
+        if (argc > 2) {
+            writeOutput("Использование: wc [file]\n");
+            return nullptr;
+        }
+        filter = new (std::nothrow) WcFilter();
+        if (!filter) return noMemory(name);
+        if (argc == 2) fileArg = 1;
+    }
+    return filter;
+}
+
+bool isFilterCommand(const char* name) {
+    return strcmp(name, "grep") == 0 || strcmp(name, "head") == 0 ||
+           strcmp(name, "tail") == 0 || strcmp(name, "wc") == 0;
+}
+
+static bool filterSink(const char* data, size_t length, void* context) {
+    PipeFilter& filter = *static_cast<PipeFilter*>(context);
+    filter.write(data, length);
+    return !filter.closed();
+}
+
+bool filterFile(PipeFilter& filter, const String& path) {
+    fs::File file = LittleFS.open(path);
+    if (!file || file.isDirectory()) return false;
+    if (!filter.closed()) streamFile(file, filterSink, &filter);
+    file.close();
+    filter.finish();
+    return true;
+}
+
+// ---- Команды: фильтр над файлом (как первая команда конвейера — тоже) ----
+
+static void runFilterCommand(int argc, const char* argv[]) {
+    int fileArg = 0;
+    PipeFilter* filter = createFilter(argc, argv, fileArg);
+    if (!filter) return;
+    if (!fileArg) {
+        writeOutput(String(argv[0]) + ": не указан файл (или используйте в конвейере: cmd | " + argv[0] + ")\n");
+    } else {
+        String path = normalizePath(argv[fileArg]);
+        if (!filterFile(*filter, path)) {
+            writeOutput("Файл не найден: " + path + "\n");
+        }
+    }
+    delete filter;
+}
+
+void handleGrep(int argc, const char* argv[]) { runFilterCommand(argc, argv); }
+void handleHead(int argc, const char* argv[]) { runFilterCommand(argc, argv); }
+// tail над файлом не читает его целиком: хвост ищется с конца файла (tailFile)
+void handleTail(int argc, const char* argv[]) {
+    const char* args[COMMAND_MAX_ARGS];
+    int count = 0;
+    bool follow = false;
+    for (int i = 0; i < argc && count < COMMAND_MAX_ARGS; i++) {
+        if (i > 0 && strcmp(argv[i], "-f") == 0) follow = true;
+        else args[count++] = argv[i];
+    }
+    uint32_t limit = FILTER_DEFAULT_LINES;
+    int fileArg = 0;
+    if (!parseLineCount(count, args, limit, fileArg)) {
+        writeOutput("Использование: tail [-n N] [-f] [file]\n");
+    } else if (!fileArg) {
+        writeOutput("tail: не указан файл (или используйте в конвейере: cmd | tail)\n");
+    } else {
+        String path = normalizePath(args[fileArg]);
+        if (!tailFile(path, limit, follow)) writeOutput("Файл не найден: " + path + "\n");
+    }
+}
+void handleWc(int argc, const char* argv[])   { runFilterCommand(argc, argv); }
@@ -1,37 +1,305 @@
 #include <commands/handle_run.h>
 #include <commands/utils.h>
+#include <commands/system.h>
 #include "vm.h"
+#include "scheduler.h"
+#include "vm_worker.h"
+#include "output.h"
+#include "log.h"
+#include <new>
 
-VirtualMachine vm; 
+// ВМ создаётся при первом запуске программы, а не при статической инициализации:
+// её конструктор восстанавливает память из файла, а ФС монтирует только initializeFS()
+static VirtualMachine* vm = nullptr;
+
+static VirtualMachine* getVirtualMachine() {
+    if (!vm) {
+        uint32_t start = micros();
+        vm = new (std::nothrow) VirtualMachine();
+        if (vm) vm->setOutputHandler(writeProgramOutput, nullptr);
+        bootRecord("vm init", start);
+    }
+    return vm;
+}
+
+#define RUN_STATS_TOP    10
+#define RUN_PROFILE_TOP  10
+
+// Отчёт о самых частых последовательностях опкодов (кандидаты в суперинструкции)
+static void printSequenceStats() {
+    OpcodeSequence stats[RUN_STATS_TOP];
+    uint32_t count = vm->collectSequences(stats, RUN_STATS_TOP);
+    writeOutput("Hot opcode sequences:\n");
+    for (uint32_t i = 0; i < count; i++) {
+        String line = "  ";
+        for (uint8_t k = 0; k < stats[i].length; k++) {
+            if (k > 0) line += " -> ";
+            line += opcodeName(stats[i].ops[k]);
+        }
+        line += "  x" + String(stats[i].count);
+        if (stats[i].fused) line += "  [fused]";
+        writeOutput(line + "\n");
+    }
+}
+
+// Класс опкода для сводки циклов профилировщика
+static const char* opcodeClass(uint8_t opcode) {
+    switch (opcode) {
+        case OP_HALT: case OP_JMP: case OP_CALL: case OP_RET: case OP_JZ: case OP_JNZ:
+            return "control";
+        case OP_LOAD: case OP_STORE: case OP_LDW: case OP_STW:
+            return "memory";
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+            return "arith";
+        case OP_PUSH: case OP_POP:
+            return "stack";
+        case OP_SYSCALL:
+            return "system";
+        default:
+            return "other";
+    }
+}
+
+// Отчёт профилировщика: опкоды по суммарным циклам, сводка по классам и горячие адреса
+static void printProfile() {
+    const VmProfile* profile = vm->profileData();
+    if (!profile) return;
+
+    uint64_t totalCount = 0;
+    uint64_t totalCycles = 0;
+    for (int op = 0; op < 256; op++) {
+        totalCount += profile->opcodeCount[op];
+        totalCycles += profile->opcodeCycles[op];
+    }
+    writeOutput("Profile: " + String((unsigned long)totalCount) + " instructions, " +
+                String((unsigned long)totalCycles) + " cycles\n");
+
+    // Опкоды по убыванию циклов (выбор максимума, опкодов немного)
+    writeOutput(column("opcode", 10) + column("count", 12) + column("cycles", 14) + "cyc/op\n");
+    bool shown[256] = {false};
+    while (true) {
+        int best = -1;
+        for (int op = 0; op < 256; op++) {
+            if (shown[op] || profile->opcodeCount[op] == 0) continue;
+            if (best < 0 || profile->opcodeCycles[op] > profile->opcodeCycles[best]) best = op;
+        }
+        if (best < 0) break;
+        shown[best] = true;
+        uint32_t count = profile->opcodeCount[best];
+        writeOutput(column(opcodeName(best), 10) + column(String(count), 12) +
+                    column(String((unsigned long)profile->opcodeCycles[best]), 14) +
+                    String((double)profile->opcodeCycles[best] / count, 1) + "\n");
+    }
+
+    writeOutput("Cycles by class:\n");
+    const char* classes[] = {"control", "memory", "arith", "stack", "system", "other"};
+    for (const char* cls : classes) {
+        uint64_t cycles = 0;
+        for (int op = 0; op < 256; op++) {
+            if (profile->opcodeCount[op] > 0 && strcmp(opcodeClass(op), cls) == 0) {
+                cycles += profile->opcodeCycles[op];
+            }
+        }
+        if (cycles == 0) continue;
+        writeOutput("  " + column(cls, 10) + column(String((unsigned long)cycles), 14) +
+                    String(totalCycles ? 100.0 * cycles / totalCycles : 0.0, 1) + "%\n");
+    }
+
+    // Горячие адреса: вставка в небольшой отсортированный список
+    uint32_t hot[RUN_PROFILE_TOP];
+    uint32_t hotCount = 0;
+    for (uint32_t addr = 0; addr < MEM_SIZE; addr++) {
+        uint32_t count = profile->pcCount[addr];
+        if (count == 0) continue;
+        if (hotCount == RUN_PROFILE_TOP && count <= profile->pcCount[hot[hotCount - 1]]) continue;
+        uint32_t i = (hotCount < RUN_PROFILE_TOP) ? hotCount++ : hotCount - 1;
+        while (i > 0 && profile->pcCount[hot[i - 1]] < count) {
+            hot[i] = hot[i - 1];
+            i--;
+        }
+        hot[i] = addr;
+    }
+    writeOutput("Hot spots:\n");
+    for (uint32_t i = 0; i < hotCount; i++) {
+        char address[12];
+        snprintf(address, sizeof(address), "0x%04X", (unsigned)hot[i]);
+        uint32_t count = profile->pcCount[hot[i]];
+        writeOutput("  " + column(address, 8) + column(opcodeName(vm->peek(hot[i])), 10) +
+                    column(String(count), 12) +
+                    String(totalCount ? 100.0 * count / totalCount : 0.0, 1) + "%\n");
+    }
+}
+
+// Отчёт об ошибке последнего запуска
+static void printFault() {
+    const VmFault& fault = vm->fault();
+    if (fault.code == FAULT_NONE) return;
+    char line[96];
+    snprintf(line, sizeof(line), "Fault: %s at 0x%04X (%s), operand 0x%X\n",
+             faultName(fault.code), (unsigned)fault.pc, opcodeName(fault.opcode),
+             (unsigned)fault.operand);
+    writeOutput(line);
+    logMessage(LOG_ERROR, "vm", "%s at 0x%04X (%s), operand 0x%X, faults: %u",
+               faultName(fault.code), (unsigned)fault.pc, opcodeName(fault.opcode),
+               (unsigned)fault.operand, (unsigned)fault.count);
+    if (fault.count > 1) {
+        writeOutput("Total faults: " + String(fault.count) + "\n");
+    }
+}
+
+// run [--verbose] [--continue] [--stats] [--profile] <file>
+void handleRun(int argc, const char* argv[]) {
+    bool verbose = false;
+    bool keepGoing = false;
+    bool stats = false;
+    bool profile = false;
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        const char* option = argv[arg];
+        if (strcmp(option, "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(option, "--continue") == 0) {
+            keepGoing = true;
+        } else if (strcmp(option, "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(option, "--profile") == 0) {
+            profile = true;
+        } else {
+            writeOutput("Unknown option: " + String(option) + "\n");
+            return;
+        }
+    }
+    if (arg >= argc) {
+        writeOutput("Usage: run [--verbose] [--continue] [--stats] [--profile] <file>\n");
+        return;
+    }
 
-void handleRun(String args) {
-    
     // Загрузка программы из файла
-    String path = normalizePath(args);
+    String path = normalizePath(argv[arg]);
     File file = LittleFS.open(path, "r");
     if (!file) {
         writeOutput("File not found: " + path + "\n");
         return;
     }
     
+    // Слишком большая программа отклоняется до создания ВМ и какого-либо чтения
     size_t size = file.size();
-    uint8_t* program = new uint8_t[size];
-    file.read(program, size);
+    if (size > IMAGE_MAX_SIZE) {
+        file.close();
+        writeOutput("Program too large: " + String(size) + " bytes (max " + String(IMAGE_MAX_SIZE) + ")\n");
+        return;
+    }
+
+    if (!getVirtualMachine()) {
+        file.close();
+        writeOutput("Not enough memory for VM\n");
+        return;
+    }
+
+    // Профилировщик включается до загрузки: от него зависит слияние инструкций
+    if (profile && !vm->setProfiling(true)) {
+        writeOutput("Not enough memory for profiling\n");
+        profile = false;
+    }
+
+    // Программа читается из файла сразу в память ВМ
+    bool loaded = vm->loadProgram(file);
     file.close();
-    
+    if (!loaded) {
+        writeOutput("Invalid or unreadable program: " + path + "\n");
+        vm->setProfiling(false);
+        return;
+    }
+
     // Отладочный вывод загруженной программы
-    Serial.println("Loaded program:");
-    for (size_t i = 0; i < size; i++) {
-        Serial.printf("%02X ", program[i]);
-        if ((i + 1) % 16 == 0) Serial.println();
+    if (verbose) {
+        String dump = "Loaded program:\n";
+        char hex[4];
+        for (size_t i = 0; i < vm->programSize(); i++) {
+            snprintf(hex, sizeof(hex), "%02X ", vm->peek(i));
+            dump += hex;
+            if ((i + 1) % 16 == 0) dump += "\n";
+        }
+        writeOutput(dump + "\n");
     }
-    Serial.println();
-    
-    // Настройка ВМ
-    vm.loadProgram(program, size);
-    vm.run();
-    vm.printState();
-    
-    delete[] program;
+
+    vm->setFaultPolicy(keepGoing ? FAULT_POLICY_CONTINUE : FAULT_POLICY_STOP);
+
+    // Программа переднего плана исполняется срезами, между которыми работают фоновые
+    // (если их исполняет отдельная задача, здесь только выводятся их сообщения).
+    // Срез, не продвинувший программу, run() завершает ошибкой, поэтому цикл конечен.
+    do {
+        vm->run(SCHED_SLICE_BUDGET);
+        if (workerActive()) {
+            workerDrain();
+        } else {
+            scheduler.tick();
+        }
+    } while (vm->isRunning());
+    // printState() пишет прямо в Serial: сначала досылается буферизованный вывод программы
+    outputFlush();
+    vm->printState();
+    printFault();
+    if (stats) {
+        printSequenceStats();
+    }
+    if (profile) {
+        printProfile();
+        vm->setProfiling(false);
+    }
+
     writeOutput("Execution finished\n");
-}
\ No newline at end of file
+}
+// bg <file> — запуск программы в фоне
+void handleBg(int argc, const char* argv[]) {
+    if (argc < 2) {
+        writeOutput("Usage: bg <file>\n");
+        return;
+    }
+    String path = normalizePath(argv[1]);
+    if (workerActive()) {
+        WorkerRequest request = {WORKER_SPAWN, 0, {0}};
+        strncpy(request.path, path.c_str(), sizeof(request.path) - 1);
+        workerCall(request);
+        return;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        writeOutput("File not found: " + path + "\n");
+        return;
+    }
+    int32_t id = scheduler.spawn(file, path);
+    file.close();
+    writeOutput(spawnMessage(id, path));
+}
+
+// ps — список фоновых программ
+void handlePs() {
+    if (workerActive()) {
+        WorkerRequest request = {WORKER_PS, 0, {0}};
+        workerCall(request);
+        return;
+    }
+    writeOutput(scheduler.listing());
+}
+
+// kill <id> — остановка фоновой программы
+void handleKill(int argc, const char* argv[]) {
+    if (argc < 2) {
+        writeOutput("Usage: kill <id>\n");
+        return;
+    }
+    long id = atol(argv[1]);
+    if (id <= 0) {
+        writeOutput("No such program: " + String(argv[1]) + "\n");
+        return;
+    }
+    if (workerActive()) {
+        WorkerRequest request = {WORKER_KILL, (uint16_t)id, {0}};
+        workerCall(request);
+        return;
+    }
+    if (!scheduler.kill(id)) {
+        writeOutput("No such program: " + String(argv[1]) + "\n");
+    }
+}
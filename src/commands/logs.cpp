@@ -1,25 +1,38 @@
 #include "commands/logs.h"
 #include "commands/utils.h"
-#include "commands/file_system.h"
+#include "console.h"
+#include <log.h>
 #include <WString.h>
 
 
-void handleInfoLog() {
-    printLastLines("/system/outputs/info.log", 6);
+static void printLog(LogChannel channel, int argc, const char* argv[]) {
+    uint32_t count = LOG_PRINT_DEFAULT;
+    if (argc > 1) {
+        char* end = nullptr;
+        count = strtoul(argv[1], &end, 10);
+        if (*end || count == 0) {
+            writeOutput("Использование: " + String(argv[0]) + " [число записей]\n");
+            setCommandFailed();
+            return;
+        }
+    }
+    logPrint(channel, count);
+}
+
+void handleInfoLog(int argc, const char* argv[]) {
+    printLog(LOG_CHANNEL_INFO, argc, argv);
 }
 
-void handleErrLog() {
-    printLastLines("/system/outputs/error.log", 6);
+void handleErrLog(int argc, const char* argv[]) {
+    printLog(LOG_CHANNEL_ERROR, argc, argv);
 }
 
 void handleClearLog(String type) {
     if (type == "info" || type == "all") {
-        LittleFS.remove("/system/outputs/info.log");
-        createFile("/system/outputs/info.log");
+        logClear(LOG_CHANNEL_INFO);
     }
     if (type == "error" || type == "all") {
-        LittleFS.remove("/system/outputs/error.log");
-        createFile("/system/outputs/error.log");
+        logClear(LOG_CHANNEL_ERROR);
     }
     writeOutput("Логи очищены\n");
-}
\ No newline at end of file
+}
@@ -2,81 +2,110 @@
 #include "Arduino.h"
 #include "console.h"
 #include "commands/utils.h"
-#include "commands/environment.h"
 #include "vm.h"
+#include "output.h"
+#include "log.h"
+#include "pipeline.h"
+#include "script_cache.h"
+#include "assembler.h"
+#include "commands/environment.h"
 
-void handleScript(String args) {
-    String path = normalizePath(args);
+void handleScript(int argc, const char* argv[]) {
+    if (argc < 2) {
+        writeOutput("Использование: skript <file>\n");
+        return;
+    }
+    String path = normalizePath(argv[1]);
     fs::File file = LittleFS.open(path);
     
-    if (!file) {
+    if (!file || file.isDirectory()) {
         writeOutput("Скрипт не найден!\n");
+        setCommandFailed();
         return;
     }
-    
-    while (file.available()) {
-        String line = file.readStringUntil('\n');
-        line.trim();
-        if (line.length() > 0) {
-            handleCommand(line);
+    file.close();
+
+    // Изменения окружения за весь скрипт записываются в EEPROM один раз в конце,
+    // а если команда скрипта завершилась ошибкой — скрипт останавливается и они отменяются
+    envBegin();
+    bool ok = true;
+    // Обычно скрипт исполняется из кэша разобранных строк (script_cache.h),
+    // без кэша строки разбираются по одной
+    if (!runCachedScript(path, ok)) {
+        file = LittleFS.open(path);
+        while (ok && file.available()) {
+            String line = file.readStringUntil('\n');
+            line.trim();
+            if (line.length() > 0) {
+                handleCommand(line.c_str());
+                ok = !lastCommandFailed();
+            }
         }
+        file.close();
+    }
+
+    if (!ok) {
+        envRollback();
+        // Во вложенном скрипте сообщает внешний, когда пакет будет отменён целиком
+        if (!envInBatch()) writeOutput("Скрипт остановлен из-за ошибки, изменения окружения отменены\n");
+    } else if (!envCommit()) {
+        if (!envInBatch()) writeOutput("Изменения окружения не сохранены\n");
+        ok = false;
+    }
+    if (!ok) {
+        logMessage(LOG_WARN, "skript", "%s: остановлен с ошибкой", path.c_str());
+        setCommandFailed();
     }
-    file.close();
 }
 
-void handleCompile(String args) {
-    // Ожидается: compile <output_file> <bytecode>
-    int firstSpace = args.indexOf(' ');
-    if (firstSpace == -1) {
+// Разделители байтов в тексте байт-кода
+static bool isByteSeparator(char c) {
+    return c == ' ' || c == ',' || c == '\n' || c == '\r';
+}
+
+void handleCompile(int argc, const char* argv[]) {
+    // Ожидается: compile <output_file> <bytecode> (argv[2] — остаток строки без разбора)
+    if (argc < 3) {
         writeOutput("Использование: compile <output_file> <bytecode>\n");
         return;
     }
 
-    String filename = args.substring(0, firstSpace);
-    String bytecodeText = args.substring(firstSpace + 1);
-
-    // Преобразуем текстовое представление в бинарный массив
+    // Преобразуем текстовое представление в бинарный массив, разбирая argv[2] на месте
     uint8_t buffer[MEM_SIZE];
     size_t bufferSize = 0;
 
-    int start = 0;
-    while (start < bytecodeText.length() && bufferSize < MEM_SIZE) {
+    const char* p = argv[2];
+    while (*p && bufferSize < MEM_SIZE) {
         // Пропускаем разделители: пробелы, запятые, переводы строки
-        while (start < bytecodeText.length() && 
-              (bytecodeText[start] == ' ' || bytecodeText[start] == ',' ||
-               bytecodeText[start] == '\n' || bytecodeText[start] == '\r')) {
-            start++;
+        if (isByteSeparator(*p)) {
+            p++;
+            continue;
         }
-        if (start >= bytecodeText.length()) break;
-
-        // Находим конец токена
-        int end = start;
-        while (end < bytecodeText.length() && 
-              (bytecodeText[end] != ' ' && bytecodeText[end] != ',' &&
-               bytecodeText[end] != '\n' && bytecodeText[end] != '\r')) {
-            end++;
+        const char* token = p;
+        // Одинарная кавычка: следующий символ берётся как байт
+        if (*p == '\'' && p[1] && !isByteSeparator(p[1])) {
+            buffer[bufferSize++] = p[1];
+            p += 2;
+            while (*p && !isByteSeparator(*p)) p++;
+            continue;
         }
-        String token = bytecodeText.substring(start, end);
-        token.trim();
-        if (token.length() > 0) {
-            // Если токен начинается с "0x" или "0X", парсим как шестнадцатиричное число
-            if (token.startsWith("0x") || token.startsWith("0X")) {
-                buffer[bufferSize++] = strtol(token.c_str(), NULL, 16);
-            }
-            // Если токен начинается с одинарной кавычки, то берём следующий символ как байт
-            else if (token.charAt(0) == '\'' && token.length() >= 2) {
-                buffer[bufferSize++] = token.charAt(1);
-            }
-            // Иначе пытаемся разобрать токен как шестнадцатиричное число без префикса
-            else {
-                buffer[bufferSize++] = strtol(token.c_str(), NULL, 16);
-            }
+        // Шестнадцатеричное число, с префиксом "0x" или без него
+        char* end = nullptr;
+        unsigned long value = strtoul(p, &end, 16);
+        if (end == p || !isxdigit((unsigned char)*p) || (*end && !isByteSeparator(*end)) || value > 0xFF) {
+            while (*p && !isByteSeparator(*p)) p++;
+            writeOutput("Неверный байт: ");
+            writeOutput(token, p - token);
+            writeOutput("\n");
+            setCommandFailed();
+            return;
         }
-        start = end + 1;
+        buffer[bufferSize++] = value;
+        p = end;
     }
 
     // Сохраняем бинарный файл
-    String fullPath = normalizePath(filename);
+    String fullPath = normalizePath(argv[1]);
     File file = LittleFS.open(fullPath, "w");
     if (!file) {
         writeOutput("Ошибка создания файла: " + fullPath + "\n");
@@ -89,78 +118,99 @@ void handleCompile(String args) {
     writeOutput("Размер: " + String(bufferSize) + " байт\n");
 }
 
-void handleEcho(String args) {
-  if (args.length() == 0) {
-    writeOutput("\n"); // Если аргументов нет, выводим пустую строку
-    return;
-  }
-  int redirectPos = args.indexOf('>');
-  String outputText = args;
-  String outputFile = "";
-  bool appendMode = false;
-  if (redirectPos != -1) {
-    outputText = args.substring(0, redirectPos);
-    outputText.trim();
-    String filePart = args.substring(redirectPos + 1);
-    filePart.trim();
-    if (filePart.startsWith(">")) {
-      appendMode = true;
-      filePart = filePart.substring(1);
-      filePart.trim();
+void handleAsm(int argc, const char* argv[]) {
+    // asm [-O] <source> [output]
+    bool optimize = argc > 1 && strcmp(argv[1], "-O") == 0;
+    int first = optimize ? 2 : 1;
+    if (argc <= first) {
+        writeOutput("Использование: asm [-O] <source> [output]\n");
+        return;
     }
-    outputFile = filePart;
-  }
-  String result = "";
-  for (size_t i = 0; i < outputText.length(); i++) {
-    char c = outputText[i];
-    if (c == '\\' && i + 1 < outputText.length()) {
-      char nextChar = outputText[i + 1];
-      switch (nextChar) {
-        case 'n': result += '\n'; break;
-        case 't': result += '\t'; break;
-        case 'r': result += '\r'; break;
-        case '\\': result += '\\'; break;
-        case '$': result += '$'; break;
-        default: result += c; result += nextChar; break;
-      }
-      i++;
-    } else if (c == '$' && i + 1 < outputText.length()) {
-      int endPos = i + 1;
-      while (endPos < outputText.length() && 
-             (isalnum(outputText[endPos]) || outputText[endPos] == '_')) {
-        endPos++;
-      }
-      String varName = outputText.substring(i + 1, endPos);
-      String varValue = getEnvVar(varName);
-      result += varValue;
-      i = endPos - 1;
+    String sourcePath = normalizePath(argv[first]);
+    String outputPath;
+    if (argc > first + 1) {
+        outputPath = normalizePath(argv[first + 1]);
     } else {
-      result += c;
+        // prog.s -> prog.bin: расширение заменяется только в имени файла
+        int dot = sourcePath.lastIndexOf('.');
+        outputPath = (dot > sourcePath.lastIndexOf('/') ? sourcePath.substring(0, dot) : sourcePath) + ".bin";
+    }
+
+    AsmResult result;
+    if (!assembleFile(sourcePath, outputPath, optimize, result)) {
+        String location = result.errorLine ? sourcePath + ":" + String(result.errorLine) + ": " : String("");
+        writeOutput("Ошибка: " + location + result.error + "\n");
+        return;
+    }
+    writeOutput("Файл создан: " + outputPath + (result.image ? " (образ с сегментами)\n" : "\n"));
+    writeOutput("Код: " + String(result.codeSize) + " байт");
+    if (result.image) {
+        writeOutput(", rodata: " + String(result.rodataSize) + ", data: " + String(result.dataSize));
     }
+    writeOutput("\nСимволы: " + String(result.symbols) + " (" + outputPath + ASM_MAP_SUFFIX + ")\n");
+    if (optimize) {
+        const PeepholeStats& stats = result.optimized;
+        writeOutput("Оптимизация: -" + String(stats.removed) + " инструкций, -" + String(stats.bytesSaved) + " байт" +
+                    " (свёртка констант: " + String(stats.folded) +
+                    ", мёртвые записи: " + String(stats.deadStores) +
+                    ", пары push/pop: " + String(stats.pushPop) +
+                    ", упрощения: " + String(stats.simplified) + ")\n");
+    }
+}
+
+// Слова выводятся через пробел; экранирование и переменные уже обработаны при разборе строки
+void handleEcho(int argc, const char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (i > 1) writeOutput(" ", 1);
+    writeOutput(argv[i], strlen(argv[i]));
   }
-  if (outputFile.length() > 0) {
-    String fullPath = normalizePath(outputFile);
-    fs::File file = LittleFS.open(fullPath, appendMode ? FILE_APPEND : FILE_WRITE);
-    if (file) {
-      file.print(result);
-      file.close();
-    } else {
-      writeOutput("Ошибка: Не удалось открыть файл для записи!\n");
+  writeOutput("\n", 1);
+}
+
+// cat -n: номер перед каждой строкой; строки выделяются в блоке memchr, без копирования
+struct NumberedLines {
+  uint32_t line;
+  bool lineStart;
+};
+
+static bool numberedSink(const char* data, size_t length, void* context) {
+  NumberedLines& state = *static_cast<NumberedLines*>(context);
+  const char* end = data + length;
+  while (data < end) {
+    if (state.lineStart) {
+      char prefix[16];
+      int size = snprintf(prefix, sizeof(prefix), "%6u\t", (unsigned)++state.line);
+      writeOutput(prefix, size);
+      state.lineStart = false;
     }
-  } else {
-    writeOutput(result + "\n");
+    const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+    const char* stop = newline ? newline + 1 : end;
+    writeOutput(data, stop - data);
+    state.lineStart = newline != nullptr;
+    data = stop;
   }
+  return !pipeClosed();
 }
 
-void catFile(String path) {
-  String fullPath = normalizePath(path);
+void handleCat(int argc, const char* argv[]) {
+  bool numbered = argc > 1 && strcmp(argv[1], "-n") == 0;
+  int fileArg = numbered ? 2 : 1;
+  if (argc <= fileArg) {
+    writeOutput("Использование: cat [-n] <file>\n");
+    return;
+  }
+  String fullPath = normalizePath(argv[fileArg]);
   fs::File file = LittleFS.open(fullPath);
   if (!file) {
     writeOutput("Файл не найден!\n");
     return;
   }
-  while (file.available()) {
-    writeOutput(String((char)file.read()));
+  // Если дальше по конвейеру ввод уже не нужен (head), файл дочитывать незачем
+  if (numbered) {
+    NumberedLines state = {0, true};
+    if (!pipeClosed()) streamFile(file, numberedSink, &state);
+  } else if (!pipeClosed()) {
+    streamFile(file, outputSink, nullptr);
   }
   writeOutput("\n");
   file.close();
@@ -1,14 +1,22 @@
 #include <Arduino.h>
 #include <commands/utils.h>
 #include <commands/system.h>
+#include <output.h>
+#include <log.h>
 
 void handleShutdown() {
     writeOutput("Система выключается...\n");
+    logMessage(LOG_INFO, "system", "выключение");
+    logFlush();
+    outputFlush();
     ESP.deepSleep(0);
 }
 
 void handleReboot() {
     writeOutput("Перезагрузка системы...\n");
+    logMessage(LOG_INFO, "system", "перезагрузка");
+    logFlush();
+    outputFlush();
     ESP.restart();
 }
 
@@ -16,4 +24,45 @@ void handleStatus() {
     String status = "Состояние системы:\n";
     status += "Версия ПО: 1.0\n";
     writeOutput(status);
-}
\ No newline at end of file
+}
+
+#define BOOT_PHASES_MAX 12
+
+struct BootPhase {
+    const char* name;
+    uint32_t duration;  // мкс
+    bool deferred;      // Выполнен после завершения setup()
+};
+
+static BootPhase bootPhases[BOOT_PHASES_MAX];
+static uint8_t bootPhaseCount = 0;
+static uint32_t bootReadyAt = 0;    // micros() на момент готовности консоли (0 — ещё грузимся)
+
+void bootRecord(const char* phase, uint32_t start) {
+    if (bootPhaseCount >= BOOT_PHASES_MAX) return;
+    bootPhases[bootPhaseCount++] = {phase, (uint32_t)(micros() - start), bootReadyAt != 0};
+}
+
+void bootFinished() {
+    bootReadyAt = micros();
+}
+
+void handleBootTime() {
+    String report = "Этапы загрузки (мкс):\n";
+    for (uint8_t i = 0; i < bootPhaseCount; i++) {
+        if (bootPhases[i].deferred) continue;
+        report += "  " + String(bootPhases[i].name) + ": " + String(bootPhases[i].duration) + "\n";
+    }
+    report += "Консоль готова через " + String(bootReadyAt) + " мкс после старта\n";
+
+    bool header = false;
+    for (uint8_t i = 0; i < bootPhaseCount; i++) {
+        if (!bootPhases[i].deferred) continue;
+        if (!header) {
+            report += "Отложенная инициализация (мкс):\n";
+            header = true;
+        }
+        report += "  " + String(bootPhases[i].name) + ": " + String(bootPhases[i].duration) + "\n";
+    }
+    writeOutput(report);
+}
@@ -1,78 +1,127 @@
 #include "commands/utils.h"
-#include "commands/environment.h"
+#include "output.h"
+#include "pipeline.h"
+#include "console.h"
 
 fs::File outputFile;
 bool outputRedirected = false;
 String currentDirectory = "/";
 
-bool checkArgs(String args, int required) {
-    int count = 0;
-    for (size_t i = 0; i < args.length(); i++) {
-        if (args[i] == ' ') count++;
+// Слова argv[from..] через пробел (для значений, которые раньше брались «до конца строки»)
+String joinArgs(int argc, const char* argv[], int from) {
+    String result;
+    for (int i = from; i < argc; i++) {
+        if (i > from) result += ' ';
+        result += argv[i];
     }
-    return (count + 1) >= required;
+    return result;
 }
 
+// Дополнение строки пробелами до ширины столбца (для таблиц в выводе команд)
+String column(const String& text, unsigned int width) {
+    String result = text;
+    while (result.length() < width) result += ' ';
+    return result;
+}
+
+// Вывод идёт в конвейер (pipeline.h), если он подключён, иначе через буфер (output.h);
+// получателя (Serial или файл) выбирает handleCommand
 void writeOutput(const String &text) {
-    if (outputRedirected && outputFile) {
-        outputFile.print(text);
-    } else {
-        Serial.print(text);
-    }
+    writeOutput(text.c_str(), text.length());
 }
 
+void writeOutput(const char* data, size_t length) {
+    if (!pipeWrite(data, length)) outputWrite(data, length);
+}
+
+// Переменные окружения подставляет разбор командной строки (tokenizer.h), здесь — только пути
 String normalizePath(String path) {
-    String result = path;
-    int pos = 0;
-    
-    while ((pos = result.indexOf('$', pos)) != -1) {
-        int endPos = pos + 1;
-        bool braceFormat = false;
-        
-        if (result.charAt(endPos) == '{') {
-            braceFormat = true;
-            endPos++;
-        }
+    // Обработка относительных путей
+    if (path.startsWith("/")) return path;
+    if (currentDirectory == "/") return "/" + path;
+    return currentDirectory + "/" + path;
+}
+
+static uint8_t fileBlock[FILE_BLOCK_SIZE];
+
+size_t streamFile(fs::File& file, BlockSink sink, void* context) {
+    size_t total = 0;
+    size_t length;
+    while ((length = file.read(fileBlock, sizeof(fileBlock))) > 0) {
+        total += length;
+        if (!sink(reinterpret_cast<const char*>(fileBlock), length, context)) break;
+    }
+    return total;
+}
+
+bool outputSink(const char* data, size_t length, void*) {
+    writeOutput(data, length);
+    return !pipeClosed();
+}
+
+void writeProgramOutput(const char* text, size_t length, void*) {
+    writeOutput(text, length);
+}
 
-        while (endPos < result.length() && 
-              (isalnum(result.charAt(endPos)) || result.charAt(endPos) == '_')) {
-            endPos++;
+// Смещение начала последних lines строк; завершающий перевод строки файла строку не начинает
+static size_t findLastLines(fs::File& file, uint32_t lines) {
+    size_t size = file.size();
+    if (lines == 0) return size;
+    size_t pos = size;
+    uint32_t found = 0;
+    while (pos > 0) {
+        size_t length = min(pos, sizeof(fileBlock));
+        pos -= length;
+        if (!file.seek(pos) || file.read(fileBlock, length) != length) return 0;
+        for (size_t i = length; i-- > 0;) {
+            if (fileBlock[i] != '\n' || pos + i == size - 1) continue;
+            if (++found == lines) return pos + i + 1;
         }
+    }
+    return 0;
+}
+
+// Дописанное в файл после offset; возвращает новое смещение
+static size_t streamAppended(const String& path, size_t offset) {
+    fs::File file = LittleFS.open(path);
+    if (!file) return offset;
+    size_t size = file.size();
+    if (size < offset) offset = 0;   // Файл очищен или пересоздан
+    if (size > offset && file.seek(offset)) offset += streamFile(file, outputSink, nullptr);
+    file.close();
+    return offset;
+}
 
-        String varName;
-        int replaceLength;
-        if (braceFormat) {
-            varName = result.substring(pos + 2, endPos);
-            replaceLength = endPos - pos;
+bool tailFile(const String& path, uint32_t lines, bool follow) {
+    fs::File file = LittleFS.open(path);
+    if (!file || file.isDirectory()) return false;
+    size_t start = findLastLines(file, lines);
+    size_t offset = start;
+    if (!pipeClosed() && file.seek(start)) offset += streamFile(file, outputSink, nullptr);
+    file.close();
+
+    // Пока идёт слежение, фоновые программы и журнал обслуживаются как в loop(),
+    // а файл перечитывается раз в TAIL_FOLLOW_POLL_MS
+    unsigned long polled = millis();
+    while (follow && !pipeClosed()) {
+        if (Serial.available()) {
+            // Ввод, остановивший слежение, командой не считается
+            while (Serial.available() && Serial.read() >= 0) {}
+            break;
+        }
+        serviceBackground();
+        if (millis() - polled >= TAIL_FOLLOW_POLL_MS) {
+            polled = millis();
+            offset = streamAppended(path, offset);
         } else {
-            varName = result.substring(pos + 1, endPos);
-            replaceLength = endPos - pos;
+            delay(1);
         }
-
-        String varValue = getEnvVar(varName); // Используем getEnvVar из environment.h
-        
-        String newResult = result.substring(0, pos);
-        newResult += varValue;
-        newResult += result.substring(pos + replaceLength);
-        result = newResult;
-        pos += varValue.length();
     }
-
-    // Обработка относительных путей
-    if (result.startsWith("/")) return result;
-    if (currentDirectory == "/") return "/" + result;
-    return currentDirectory + "/" + result;
+    return true;
 }
 
-void printLastLines(String path, int lines) {
-  fs::File file = LittleFS.open(path);
-  if (!file) {
+void printLastLines(const String& path, uint32_t lines) {
+  if (!tailFile(path, lines, false)) {
     writeOutput("Лог файл не найден\n");
-    return;
-  }
-  // Здесь можно реализовать чтение последних строк файла (при необходимости)
-  while (file.available()) {
-    writeOutput(String((char)file.read()));
   }
-  file.close();
 }
\ No newline at end of file
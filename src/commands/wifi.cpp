@@ -36,15 +36,14 @@ bool findWifiInList(const String& ssid, String& password) {
   return false;
 }
 
-void handleWifi(String args) {
-    int spacePos = args.indexOf(' ');
-    if (spacePos == -1) {
+void handleWifi(int argc, const char* argv[]) {
+    if (argc < 3) {
         writeOutput("Использование: wifi <SSID> <password>\n");
         return;
     }
 
-    String ssid = args.substring(0, spacePos);
-    String password = args.substring(spacePos + 1);
+    String ssid = argv[1];
+    String password = joinArgs(argc, argv, 2);
 
     // Проверяем, существует ли уже такая сеть
     if (isWifiExists(ssid)) {
@@ -101,13 +100,13 @@ void handleWifiList() {
     file.close();
 }
 
-void handleWifiRemove(String args) {
-    if (args.length() == 0) {
+void handleWifiRemove(int argc, const char* argv[]) {
+    if (argc < 2) {
         writeOutput("Использование: wifiremove <SSID>\n");
         return;
     }
 
-    String targetSSID = args;
+    String targetSSID = argv[1];
     String tempContent = "";
     bool found = false;
 
@@ -177,14 +176,15 @@ void writeWifiConfig(const WifiConfig& config) {
 }
 
 // Обработчики команд
-void handleWifiMode(String args) {
+void handleWifiMode(int argc, const char* argv[]) {
     WifiConfig config = readWifiConfig();
+    const char* mode = argc > 1 ? argv[1] : "";
     
-    if(args == "create") {
+    if(strcmp(mode, "create") == 0) {
         config.createMode = true;
         writeOutput("Режим установлен: Создание точки доступа\n");
     }
-    else if(args == "connect") {
+    else if(strcmp(mode, "connect") == 0) {
         config.createMode = false;
         writeOutput("Режим установлен: Подключение к сети\n");
     }
@@ -196,36 +196,33 @@ void handleWifiMode(String args) {
     writeWifiConfig(config);
 }
 
-void handleWifiCreate(String args) {
+void handleWifiCreate(int argc, const char* argv[]) {
     WifiConfig config = readWifiConfig();
     if(!config.createMode) {
         writeOutput("Сначала переключитесь в режим создания: wifimode create\n");
         return;
     }
 
-    int space1 = args.indexOf(' ');
-    int space2 = args.lastIndexOf(' ');
-    
-    if(space1 == -1 || space1 == space2) {
+    if(argc < 3) {
         writeOutput("Использование: wificreate <SSID> <PASSWORD> [CHANNEL]\n");
         return;
     }
     
-    config.ssid = args.substring(0, space1);
-    config.password = args.substring(space1+1, space2);
-    config.channel = (space2 != -1) ? args.substring(space2+1).toInt() : 6;
+    config.ssid = argv[1];
+    config.password = argv[2];
+    config.channel = (argc > 3) ? atoi(argv[3]) : 6;
     
     writeWifiConfig(config);
     writeOutput("Точка доступа настроена!\n");
 }
 
-void handleWifiConnect(String args) {
-    if (args.length() == 0) {
+void handleWifiConnect(int argc, const char* argv[]) {
+    if (argc < 2) {
         writeOutput("Использование: wificonnect <SSID>\n");
         return;
     }
 
-    String ssid = args;
+    String ssid = argv[1];
     String password;
 
     // Ищем сеть в списке
@@ -1,12 +1,18 @@
 #include "console.h"
 #include "command_includes.h"
-#include <map>
-#include <functional>
 #include <vm.h>
+#include <output.h>
+#include <tokenizer.h>
+#include <pipeline.h>
+#include <log.h>
+#include <scheduler.h>
+#include <vm_worker.h>
 #include <EEPROM.h>
 
+// Единственное место монтирования LittleFS: остальной код (в том числе ВМ) считает ФС готовой
 void initializeFS() {
   Serial.println("\nИнициализация LittleFS...");
+  uint32_t start = micros();
   if (!LittleFS.begin(true)) {
     Serial.println("Ошибка монтирования, пробуем форматировать...");
     if (!LittleFS.format()) {
@@ -18,14 +24,20 @@ void initializeFS() {
       return;
     }
   }
+  bootRecord("littlefs mount", start);
+
+  start = micros();
   EEPROM.begin(EEPROM_SIZE);
   loadEnvVars();  // Функция загрузки переменных окружения из EEPROM
+  bootRecord("eeprom + env", start);
+
+  start = micros();
 
   // Создание структуры каталогов
   const char* dirs[] = {
     "/system", "/system/outputs", "/config",
     "/utils", "/utils/scripts", "/utils/tools", 
-    "/home", "/system/systemdata.dat"
+    "/home"
   };
 
   for (const char* dir : dirs) {
@@ -39,8 +51,6 @@ void initializeFS() {
   // Создание базовых конфигурационных файлов
   const char* files[] = {
     "/system/board.conf",
-    "/system/outputs/info.log",
-    "/system/outputs/error.log",
     "/system/settings.conf",
     "/system/device_info.conf",
     "/config/wifi.conf",
@@ -71,110 +81,255 @@ void initializeFS() {
     fs::File f = LittleFS.open("/system/systemdata.dat", "w");
     f.close();
   }
+  bootRecord("fs layout", start);
+
+  start = micros();
+  logBegin();
+  bootRecord("log", start);
   Serial.println("Файловая система готова\n");
 }
 
-Command parseCommand(String input) {
-    Command cmd;
-    int firstSpace = input.indexOf(' ');
-    if (firstSpace == -1) {
-        cmd.name = input;
-        cmd.args = "";
+// ---- Таблица команд ----
+
+typedef void (*CommandHandler)(int argc, const char* argv[]);
+
+struct CommandEntry {
+    const char* name;
+    CommandHandler handler;
+    uint8_t minArgs;    // Сколько аргументов (кроме имени) нужно, чтобы вызвать обработчик
+    uint8_t rawFrom;    // С какого аргумента остаток строки передаётся без разбора (0 — нет)
+};
+
+// Адаптеры функций модулей к виду CommandHandler
+template <void (*F)(const String&)> static void pathArg(int argc, const char* argv[]) {
+    F(argc > 1 ? argv[1] : "");
+}
+template <void (*F)(const String&, const String&)> static void twoPaths(int, const char* argv[]) {
+    F(argv[1], argv[2]);
+}
+template <void (*F)()> static void noArgs(int, const char*[]) { F(); }
+
+static void clearAllLogs(int, const char*[])   { handleClearLog("all"); }
+static void clearInfoLog(int, const char*[])   { handleClearLog("info"); }
+static void clearErrorLog(int, const char*[])  { handleClearLog("error"); }
+static void printTreeCommand(int argc, const char* argv[]) { printTree(argc > 1 ? argv[1] : ""); }
+
+// Таблица строится при компиляции и отсортирована по имени (проверяется static_assert):
+// поиск — двоичный, без выделения памяти
+static constexpr CommandEntry commandTable[] = {
+    {"asm",          handleAsm,                0, 0},
+    {"bg",           handleBg,                 0, 0},
+    {"boottime",     noArgs<handleBootTime>,   0, 0},
+    {"cat",          handleCat,                0, 0},
+    {"cd",           pathArg<changeDir>,       1, 0},
+    {"clear",        clearAllLogs,             0, 0},
+    {"clearerrlog",  clearErrorLog,            0, 0},
+    {"clearinfolog", clearInfoLog,             0, 0},
+    {"compile",      handleCompile,            0, 2},
+    {"cp",           twoPaths<copyFile>,       2, 0},
+    {"echo",         handleEcho,               0, 0},
+    {"envbegin",     noArgs<handleEnvBegin>,   0, 0},
+    {"envcommit",    noArgs<handleEnvCommit>,  0, 0},
+    {"envrollback",  noArgs<handleEnvRollback>, 0, 0},
+    {"errlog",       handleErrLog,             0, 0},
+    {"getenv",       handleGetEnv,             0, 0},
+    {"grep",         handleGrep,               0, 0},
+    {"head",         handleHead,               0, 0},
+    {"help",         noArgs<printHelp>,        0, 0},
+    {"info",         noArgs<printFSInfo>,      0, 0},
+    {"infolog",      handleInfoLog,            0, 0},
+    {"kill",         handleKill,               0, 0},
+    {"ls",           pathArg<listFiles>,       0, 0},
+    {"mkdir",        pathArg<createDir>,       1, 0},
+    {"mv",           twoPaths<moveFile>,       2, 0},
+    {"printenv",     noArgs<handlePrintEnv>,   0, 0},
+    {"ps",           noArgs<handlePs>,         0, 0},
+    {"pwd",          noArgs<printWorkingDir>,  0, 0},
+    {"reboot",       noArgs<handleReboot>,     0, 0},
+    {"rm",           pathArg<deleteFile>,      1, 0},
+    {"rmdir",        pathArg<deleteDir>,       1, 0},
+    {"run",          handleRun,                0, 0},
+    {"setenv",       handleSetEnv,             0, 0},
+    {"shutdown",     noArgs<handleShutdown>,   0, 0},
+    {"skript",       handleScript,             0, 0},
+    {"status",       noArgs<handleStatus>,     0, 0},
+    {"tail",         handleTail,               0, 0},
+    {"touch",        pathArg<createFile>,      1, 0},
+    {"tree",         printTreeCommand,         0, 0},
+    {"unsetenv",     handleUnsetEnv,           0, 0},
+    {"wc",           handleWc,                 0, 0},
+    {"wifi",         handleWifi,               0, 0},
+    {"wificonnect",  handleWifiConnect,        0, 0},
+    {"wificreate",   handleWifiCreate,         0, 0},
+    {"wifiinfo",     noArgs<handleWifiInfo>,   0, 0},
+    {"wifilist",     noArgs<handleWifiList>,   0, 0},
+    {"wifimode",     handleWifiMode,           0, 0},
+    {"wifiremove",   handleWifiRemove,         0, 0},
+};
+
+static constexpr size_t COMMAND_COUNT = sizeof(commandTable) / sizeof(commandTable[0]);
+
+// Сравнение имён при компиляции (рекурсия вместо цикла — совместимо с C++11)
+static constexpr int compareNames(const char* a, const char* b) {
+    return (*a != *b || *a == 0) ? (int)(unsigned char)*a - (int)(unsigned char)*b
+                                 : compareNames(a + 1, b + 1);
+}
+
+static constexpr bool commandsSorted(const CommandEntry* table, size_t count) {
+    return count < 2 || (compareNames(table[0].name, table[1].name) < 0 && commandsSorted(table + 1, count - 1));
+}
+
+static_assert(commandsSorted(commandTable, COMMAND_COUNT), "Таблица команд должна быть отсортирована по имени без повторов");
+
+// Отпечаток таблицы (FNV-1a по именам и rawFrom): кэш скриптов хранит номера команд и
+// способ разбора, поэтому после любого изменения таблицы он пересобирается
+static constexpr uint32_t hashName(const char* name, uint32_t hash) {
+    return *name ? hashName(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+static constexpr uint32_t hashTable(const CommandEntry* table, size_t count, uint32_t hash) {
+    return count == 0 ? hash
+                      : hashTable(table + 1, count - 1, (hashName(table->name, hash) ^ table->rawFrom) * 16777619u);
+}
+
+static constexpr uint32_t COMMAND_TABLE_HASH = hashTable(commandTable, COMMAND_COUNT, 2166136261u);
+
+// Поиск по имени длиной length (имя в строке не завершено нулём)
+static const CommandEntry* findCommand(const char* name, size_t length) {
+    size_t low = 0, high = COMMAND_COUNT;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int order = strncmp(commandTable[mid].name, name, length);
+        if (order == 0 && commandTable[mid].name[length] != 0) order = 1;
+        if (order == 0) return &commandTable[mid];
+        if (order < 0) low = mid + 1;
+        else high = mid;
+    }
+    return nullptr;
+}
+
+int lookupCommand(const char* input) {
+    const char* name = input;
+    while (*name == ' ' || *name == '\t') name++;
+    const CommandEntry* entry = findCommand(name, strcspn(name, " \t\r\n>|"));
+    return entry ? entry - commandTable : -1;
+}
+
+uint8_t commandRawFrom(int index) {
+    return index >= 0 ? commandTable[index].rawFrom : 0;
+}
+
+uint32_t commandTableHash() {
+    return COMMAND_TABLE_HASH;
+}
+
+static bool commandFailed = false;
+
+void setCommandFailed() {
+    commandFailed = true;
+}
+
+bool lastCommandFailed() {
+    return commandFailed;
+}
+
+void serviceBackground() {
+    if (workerActive()) {
+        workerDrain();
     } else {
-        cmd.name = input.substring(0, firstSpace);
-        cmd.args = input.substring(firstSpace + 1);
+        scheduler.tick();
     }
-    return cmd;
+    logTick();
 }
 
-void handleCommand(String input) {
-    int redirectPos = input.indexOf(">");
-    String outputFilename;
-    int mode = 0;
+void handleCommand(const char* input) {
+    commandFailed = false;
+    // От команды зависит разбор её аргументов, поэтому имя ищется до разбора строки
+    int index = lookupCommand(input);
+    CommandLine line;
+    TokenizeStatus status = tokenize(input, line, commandRawFrom(index));
+    if (status == TOKENIZE_EMPTY) return;
+    if (status != TOKENIZE_OK) {
+        writeOutput(String(tokenizeError(status)) + "\n");
+        commandFailed = true;
+        return;
+    }
+    executeCommand(index, line);
+}
 
-    if (redirectPos != -1) {
-        if (input.charAt(redirectPos + 1) == '>') {
-            mode = 2;
-            outputFilename = input.substring(redirectPos + 2);
-        } else {
-            mode = 1;
-            outputFilename = input.substring(redirectPos + 1);
-        }
-        input = input.substring(0, redirectPos);
-        outputFilename.trim();
-        input.trim();
-
-        if (outputFilename.length() > 0) {
-            String fullPath = normalizePath(outputFilename);
-            outputFile = LittleFS.open(fullPath, (mode == 1) ? FILE_WRITE : FILE_APPEND);
-            outputRedirected = true;
+void executeCommand(int index, CommandLine& line) {
+    const CommandEntry* entry = index >= 0 ? &commandTable[index] : nullptr;
+    commandFailed = false;
+
+    // Команды после '|' — фильтры, через которые проходит вывод первой команды.
+    // Создаются до открытия файла перенаправления, чтобы ошибки в них шли в консоль.
+    PipeFilter* filters[COMMAND_MAX_STAGES] = {};
+    bool ready = true;
+    for (uint8_t i = 1; i < line.stages && ready; i++) {
+        const char** argv = line.stageArgv(i);
+        int fileArg = 0;
+        if (!isFilterCommand(argv[0])) {
+            writeOutput("Команда не читает ввод конвейера: " + String(argv[0]) + "\n");
+            ready = false;
+        } else if (!(filters[i] = createFilter(line.stageArgc(i), argv, fileArg))) {
+            ready = false;
+        } else if (fileArg) {
+            writeOutput(String(argv[0]) + ": в конвейере ввод берётся из предыдущей команды\n");
+            ready = false;
+        } else if (i > 1) {
+            filters[i - 1]->next = filters[i];
         }
     }
+    if (!ready) {
+        for (PipeFilter* filter : filters) delete filter;
+        commandFailed = true;
+        return;
+    }
 
-    Command cmd = parseCommand(input);
+    if (line.redirect) {
+        String fullPath = normalizePath(line.redirect);
+        outputFile = LittleFS.open(fullPath, line.append ? FILE_APPEND : FILE_WRITE);
+        outputRedirected = true;
+        if (outputFile) outputRedirect(&outputFile);
+    }
 
     //TODO: функции должны только возвращать данные а не выводить данные на прямую в сериал
     //TODO: реализовать потоки для ввода и вывода 
 
-    // Карта команд с функциями-обработчиками
-    std::map<String, std::function<void(String)>> commandHandlers = {
-        {"ls", [](String args) { listFiles(args); }},
-        {"cat", [](String args) { if (checkArgs(args, 1)) catFile(args); }},
-        {"touch", [](String args) { if (checkArgs(args, 1)) createFile(args); }},
-        {"echo", [](String args) { handleEcho(args); }},
-        {"rm", [](String args) { if (checkArgs(args, 1)) deleteFile(args); }},
-        {"mkdir", [](String args) { if (checkArgs(args, 1)) createDir(args); }},
-        {"rmdir", [](String args) { if (checkArgs(args, 1)) deleteDir(args); }},
-        {"cd", [](String args) { if (checkArgs(args, 1)) changeDir(args); }},
-        {"pwd", [](String) { printWorkingDir(); }},
-        {"tree", [](String args) { printTree(args); }},
-        {"info", [](String) { printFSInfo(); }},
-        {"cp", [](String args) { if (checkArgs(args, 2)) copyFile(args); }},
-        {"mv", [](String args) { if (checkArgs(args, 2)) moveFile(args); }},
-        {"setenv", [](String args) { handleSetEnv(args); }},
-        {"getenv", [](String args) { handleGetEnv(args); }},
-        {"unsetenv", [](String args) { handleUnsetEnv(args); }},
-        {"printenv", [](String) { handlePrintEnv(); }},
-        {"shutdown", [](String) { handleShutdown(); }},
-        {"reboot", [](String) { handleReboot(); }},
-        {"status", [](String) { handleStatus(); }},
-        {"skript", [](String args) { handleScript(args); }},
-        {"run", [](String args) { handleRun(args); }},
-        {"infolog", [](String) { handleInfoLog(); }},
-        {"errlog", [](String) { handleErrLog(); }},
-        {"clear", [](String args) { handleClearLog("all"); }},
-        {"clearinfolog", [](String) { handleClearLog("info"); }},
-        {"clearerrlog", [](String) { handleClearLog("error"); }},
-        {"wifi", [](String args) { handleWifi(args); }},
-        {"wifimode", [](String args) { handleWifiMode(args); }},
-        {"wificreate", [](String args) { handleWifiCreate(args); }},
-        {"wificonnect", [](String args) { handleWifiConnect(args); }},
-        {"wifiinfo", [](String) { handleWifiInfo(); }},
-        {"wifilist", [](String) { handleWifiList(); }},
-        {"wifiremove", [](String args) { handleWifiRemove(args); }},
-        {"wificonnect", [](String args) { handleWifiConnect(args); }},
-        {"compile", [](String args) { handleCompile(args); }},
-        {"help", [](String) { printHelp(); }}
-
-    };
-
-    if (commandHandlers.find(cmd.name) != commandHandlers.end()) {
-        commandHandlers[cmd.name](cmd.args);
-    } else {
+    // Конвейер подключается только для команды с фильтрами: вложенные команды
+    // (строки skript, повтор .skc) без '|' пишут в конвейер внешней команды
+    PipeFilter* outerPipe = nullptr;
+    if (line.stages > 1) outerPipe = pipeBegin(filters[1]);
+    if (!entry) {
         writeOutput("Неизвестная команда\n");
+        commandFailed = true;
+    } else if (line.argc - 1 < entry->minArgs) {
+        writeOutput("Недостаточно аргументов: " + String(entry->name) + "\n");
+        commandFailed = true;
+    } else {
+        entry->handler(line.argc, line.argv);
     }
+    if (line.stages > 1) pipeEnd(outerPipe);
+    for (PipeFilter* filter : filters) delete filter;
 
     if (outputRedirected && outputFile) {
+        // Буфер вывода дописывается в файл до его закрытия
+        outputRedirect(nullptr);
         outputFile.close();
-        outputRedirected = false;
     }
+    outputRedirected = false;
 }
 
 void printHelp() {
     String helpText = "Доступные команды:\n";
     helpText += "help - эта справка\n";
     helpText += "ls [path] - список файлов\n";
-    helpText += "cat <file> - показать содержимое\n";
+    helpText += "cat [-n] <file> - показать содержимое (-n — с номерами строк)\n";
+    helpText += "grep [-v] [-i] [-c] <образец> [file] - строки с образцом\n";
+    helpText += "head/tail [-n N] [file] - первые/последние N строк\n";
+    helpText += "tail -f <file> - следить за дописываемым в файл\n";
+    helpText += "wc [file] - строки, слова, байты\n";
+    helpText += "cmd | grep ... | tail N - конвейер команд\n";
     helpText += "touch <file> - создать файл\n";
     helpText += "echo <text> > file - записать в файл\n";
     helpText += "rm <file> - удалить файл\n";
@@ -190,12 +345,17 @@ void printHelp() {
     helpText += "getenv <key> - получить переменную\n";
     helpText += "unsetenv <key> - удалить переменную\n";
     helpText += "printenv - все переменные\n";
+    helpText += "envbegin/envcommit/envrollback - пакет изменений окружения\n";
     helpText += "shutdown - Выключение\n";
     helpText += "reboot - Перезагрузка\n";
     helpText += "status - Состояние системы\n";
+    helpText += "boottime - Время этапов загрузки\n";
     helpText += "skript <file> - Выполнить скрипт\n";
-    helpText += "run <file> - Запуск программы\n";
-    helpText += "infolog/errlog - Просмотр логов\n";
+    helpText += "run [--verbose] [--continue] [--stats] [--profile] <file> - Запуск программы\n";
+    helpText += "bg <file> - Запуск программы в фоне\n";
+    helpText += "ps - Фоновые программы\n";
+    helpText += "kill <id> - Остановить фоновую программу\n";
+    helpText += "infolog/errlog [N] - Последние N записей журнала\n";
     helpText += "clear* - Очистка логов\n";
     helpText += "wifi <ssid> <pass> - Добавить сеть в список\n";
     helpText += "wifilist - Список сетей\n";
@@ -206,6 +366,7 @@ void printHelp() {
     helpText += "wificonnect <ssid> <pass> - Настроить подключение\n";
     helpText += "wifiinfo - Показать текущие настройки\n";
     helpText += "compile <file> <bytecode> - Создать бинарный файл из текстового байт-кода\n";
+    helpText += "asm [-O] <source> [output] - Собрать программу из ассемблера (и карту символов .map)\n";
     writeOutput(helpText);
 }
 
@@ -0,0 +1,349 @@
+#include "log.h"
+#include <LittleFS.h>
+#include <commands/utils.h>
+#include <stdarg.h>
+
+#if !defined(ARDUINO_ARCH_ESP32)
+#include <mutex>
+#endif
+
+#define LOG_DIR           "/system/outputs/"
+#define LOG_RECORD_MAGIC  0xA5
+
+static const char LOG_SEGMENT_MAGIC[4] = {'L', 'O', 'G', '1'};
+
+// Заголовок сегмента; sequence растёт с каждым новым сегментом канала
+struct LogSegmentHeader {
+    char magic[4];
+    uint32_t sequence;
+};
+
+// Заголовок записи, за ним метка и текст (без нулей в конце)
+struct LogRecordHeader {
+    uint8_t magic;
+    uint8_t level;
+    uint8_t tagLength;
+    uint8_t textLength;
+    uint32_t time;           // millis() на момент записи
+};
+
+static_assert(sizeof(LogSegmentHeader) == 8, "Заголовок сегмента журнала — 8 байт");
+static_assert(sizeof(LogRecordHeader) == 8, "Заголовок записи журнала — 8 байт");
+static_assert(sizeof(LogRecordHeader) + LOG_TAG_MAX + LOG_TEXT_MAX <= LOG_BUFFER_SIZE,
+              "Запись журнала должна помещаться в буфер канала");
+static_assert(sizeof(LogSegmentHeader) + LOG_BUFFER_SIZE <= LOG_SEGMENT_SIZE,
+              "Буфер канала должен помещаться в сегмент");
+
+struct ChannelState {
+    const char* name;
+    uint8_t segment;         // Текущий сегмент
+    uint32_t sequence;       // Его номер (0 — сегментов ещё нет)
+    uint32_t size;           // Его размер в файле (0 — ещё не создан)
+    uint8_t buffer[LOG_BUFFER_SIZE];
+    uint16_t pending;        // Байт в буфере
+    uint32_t bufferedAt;     // millis() первой записи в буфере
+};
+
+static ChannelState channels[LOG_CHANNELS] = {
+    {"info", 0, 0, 0, {0}, 0, 0},
+    {"error", 0, 0, 0, {0}, 0, 0},
+};
+static bool ready = false;
+
+static const char* const levelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// ---- Платформенная часть: блокировка журнала ----
+
+#if defined(ARDUINO_ARCH_ESP32)
+static SemaphoreHandle_t mutex = nullptr;
+
+static bool createLock() {
+    mutex = xSemaphoreCreateMutex();
+    return mutex != nullptr;
+}
+static void lock()   { xSemaphoreTake(mutex, portMAX_DELAY); }
+static void unlock() { xSemaphoreGive(mutex); }
+#else
+static std::mutex mutex;
+
+static bool createLock() { return true; }
+static void lock()   { mutex.lock(); }
+static void unlock() { mutex.unlock(); }
+#endif
+
+// ---- Сегменты ----
+
+static void segmentPath(const ChannelState& ch, uint8_t index, char* path, size_t size) {
+    snprintf(path, size, LOG_DIR "%s.%u.log", ch.name, (unsigned)index);
+}
+
+static bool readRecord(fs::File& file, LogRecordHeader& header, char* tag, char* text) {
+    if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != LOG_RECORD_MAGIC || header.level > LOG_ERROR ||
+        header.tagLength > LOG_TAG_MAX || header.textLength > LOG_TEXT_MAX) {
+        return false;
+    }
+    if (file.read(reinterpret_cast<uint8_t*>(tag), header.tagLength) != header.tagLength) return false;
+    if (file.read(reinterpret_cast<uint8_t*>(text), header.textLength) != header.textLength) return false;
+    tag[header.tagLength] = 0;
+    text[header.textLength] = 0;
+    return true;
+}
+
+// Номер сегмента из заголовка (0 — файла нет или он не сегмент журнала)
+static uint32_t readSequence(fs::File& file) {
+    LogSegmentHeader header;
+    if (!file || file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)) return 0;
+    if (memcmp(header.magic, LOG_SEGMENT_MAGIC, sizeof(header.magic)) != 0) return 0;
+    return header.sequence;
+}
+
+// Новый сегмент index с номером sequence + 1 (прежнее содержимое файла стирается)
+static bool startSegment(ChannelState& ch, uint8_t index) {
+    char path[32];
+    segmentPath(ch, index, path, sizeof(path));
+    fs::File file = LittleFS.open(path, FILE_WRITE);
+    ch.segment = index;
+    ch.size = 0;
+    if (!file) return false;
+    LogSegmentHeader header;
+    memcpy(header.magic, LOG_SEGMENT_MAGIC, sizeof(header.magic));
+    header.sequence = ch.sequence + 1;
+    bool written = file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    file.close();
+    if (!written) return false;
+    ch.sequence = header.sequence;
+    ch.size = sizeof(header);
+    return true;
+}
+
+// Буфер канала — одним блоком в текущий сегмент; при ошибке записи буфер теряется,
+// чтобы недоступная ФС не останавливала пишущих в журнал
+static void flushChannel(ChannelState& ch) {
+    if (ch.pending == 0) return;
+    if (ch.size == 0 && !startSegment(ch, ch.segment)) {
+        ch.pending = 0;
+        return;
+    }
+    char path[32];
+    segmentPath(ch, ch.segment, path, sizeof(path));
+    fs::File file = LittleFS.open(path, FILE_APPEND);
+    if (file) {
+        ch.size += file.write(ch.buffer, ch.pending);
+        file.close();
+    }
+    ch.pending = 0;
+}
+
+// Текущий сегмент — с наибольшим номером. Если он заканчивается оборванной записью,
+// следующая запись начнёт новый сегмент, чтобы не писать за повреждённым местом
+static void findSegment(ChannelState& ch) {
+    ch.segment = 0;
+    ch.sequence = 0;
+    ch.size = 0;
+    ch.pending = 0;
+    char path[32];
+    for (uint8_t i = 0; i < LOG_SEGMENTS; i++) {
+        segmentPath(ch, i, path, sizeof(path));
+        if (!LittleFS.exists(path)) continue;
+        fs::File file = LittleFS.open(path, FILE_READ);
+        uint32_t sequence = readSequence(file);
+        if (sequence > ch.sequence) {
+            ch.segment = i;
+            ch.sequence = sequence;
+            ch.size = file.size();
+        }
+        file.close();
+    }
+    if (ch.sequence == 0) return;
+
+    segmentPath(ch, ch.segment, path, sizeof(path));
+    fs::File file = LittleFS.open(path, FILE_READ);
+    file.seek(sizeof(LogSegmentHeader));
+    LogRecordHeader header;
+    char tag[LOG_TAG_MAX + 1];
+    char text[LOG_TEXT_MAX + 1];
+    uint32_t end = file.position();
+    while (readRecord(file, header, tag, text)) {
+        end = file.position();
+    }
+    if (end != ch.size) ch.size = LOG_SEGMENT_SIZE;
+    file.close();
+}
+
+// ---- Запись ----
+
+void logBegin() {
+    if (!ready && !createLock()) return;
+    lock();
+    for (ChannelState& ch : channels) {
+        findSegment(ch);
+    }
+    ready = true;
+    unlock();
+}
+
+void logMessage(LogLevel level, const char* tag, const char* format, ...) {
+    if (!ready || level < LOG_LEVEL_MIN) return;
+
+    uint8_t record[sizeof(LogRecordHeader) + LOG_TAG_MAX + LOG_TEXT_MAX + 1];
+    LogRecordHeader header;
+    header.magic = LOG_RECORD_MAGIC;
+    header.level = level > LOG_ERROR ? LOG_ERROR : level;
+    header.tagLength = min(strlen(tag), (size_t)LOG_TAG_MAX);
+    header.time = millis();
+    char* text = reinterpret_cast<char*>(record) + sizeof(header) + header.tagLength;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, LOG_TEXT_MAX + 1, format, args);
+    va_end(args);
+    header.textLength = length < 0 ? 0 : min(length, LOG_TEXT_MAX);
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), tag, header.tagLength);
+    size_t size = sizeof(header) + header.tagLength + header.textLength;
+
+    ChannelState& ch = channels[level >= LOG_ERROR ? LOG_CHANNEL_ERROR : LOG_CHANNEL_INFO];
+    lock();
+    // Запись целиком в одном сегменте: не помещается — сегмент закрывается, следующий по кольцу
+    if (ch.size != 0 && ch.size + ch.pending + size > LOG_SEGMENT_SIZE) {
+        flushChannel(ch);
+        startSegment(ch, (ch.segment + 1) % LOG_SEGMENTS);
+    }
+    if (ch.pending + size > LOG_BUFFER_SIZE) {
+        flushChannel(ch);
+    }
+    if (ch.pending == 0) ch.bufferedAt = millis();
+    memcpy(ch.buffer + ch.pending, record, size);
+    ch.pending += size;
+    if (level >= LOG_ERROR) flushChannel(ch);
+    unlock();
+}
+
+void logTick() {
+    if (!ready) return;
+    lock();
+    for (ChannelState& ch : channels) {
+        if (ch.pending && millis() - ch.bufferedAt >= LOG_FLUSH_INTERVAL_MS) flushChannel(ch);
+    }
+    unlock();
+}
+
+void logFlush() {
+    if (!ready) return;
+    lock();
+    for (ChannelState& ch : channels) {
+        flushChannel(ch);
+    }
+    unlock();
+}
+
+// ---- Чтение ----
+
+// Сегменты канала от старого к новому и их номера; результат — их число
+static uint8_t orderedSegments(const ChannelState& ch, uint8_t* order, uint32_t* sequences) {
+    uint8_t count = 0;
+    char path[32];
+    for (uint8_t i = 0; i < LOG_SEGMENTS; i++) {
+        segmentPath(ch, i, path, sizeof(path));
+        if (!LittleFS.exists(path)) continue;
+        fs::File file = LittleFS.open(path, FILE_READ);
+        uint32_t sequence = readSequence(file);
+        file.close();
+        if (sequence == 0) continue;
+        uint8_t j = count++;
+        for (; j > 0 && sequences[j - 1] > sequence; j--) {
+            sequences[j] = sequences[j - 1];
+            order[j] = order[j - 1];
+        }
+        sequences[j] = sequence;
+        order[j] = i;
+    }
+    return count;
+}
+
+// Число записей в каждом сегменте (counts); результат — сумма
+static uint32_t countRecords(const ChannelState& ch, const uint8_t* order, uint8_t segments,
+                             uint32_t* counts) {
+    LogRecordHeader header;
+    char tag[LOG_TAG_MAX + 1];
+    char text[LOG_TEXT_MAX + 1];
+    char path[32];
+    uint32_t total = 0;
+    for (uint8_t s = 0; s < segments; s++) {
+        segmentPath(ch, order[s], path, sizeof(path));
+        fs::File file = LittleFS.open(path, FILE_READ);
+        file.seek(sizeof(LogSegmentHeader));
+        counts[s] = 0;
+        while (readRecord(file, header, tag, text)) counts[s]++;
+        file.close();
+        total += counts[s];
+    }
+    return total;
+}
+
+// Вывод записей, посчитанных countRecords(), кроме первых skip. Вызывается без блокировки:
+// сегмент, который успели перезаписать по кольцу (номер не совпадает), пропускается,
+// а дописанные после подсчёта записи не выводятся
+static void printRecords(const ChannelState& ch, const uint8_t* order, const uint32_t* sequences,
+                         const uint32_t* counts, uint8_t segments, uint32_t skip) {
+    LogRecordHeader header;
+    char tag[LOG_TAG_MAX + 1];
+    char text[LOG_TEXT_MAX + 1];
+    char line[LOG_TAG_MAX + LOG_TEXT_MAX + 32];
+    char path[32];
+    for (uint8_t s = 0; s < segments; s++) {
+        if (skip >= counts[s]) {
+            skip -= counts[s];
+            continue;
+        }
+        segmentPath(ch, order[s], path, sizeof(path));
+        fs::File file = LittleFS.open(path, FILE_READ);
+        if (readSequence(file) == sequences[s]) {
+            for (uint32_t i = 0; i < counts[s] && readRecord(file, header, tag, text); i++) {
+                if (i < skip) continue;
+                snprintf(line, sizeof(line), "[%6lu.%03lu] %-5s %s: %s\n",
+                         (unsigned long)(header.time / 1000), (unsigned long)(header.time % 1000),
+                         levelNames[header.level], tag, text);
+                writeOutput(line);
+            }
+        }
+        if (file) file.close();
+        skip = 0;
+    }
+}
+
+// Под блокировкой только сброс буфера и подсчёт записей: вывод в консоль может идти
+// долго, и задача ВМ не должна ждать его в logMessage()
+void logPrint(LogChannel channel, uint32_t count) {
+    if (!ready || channel >= LOG_CHANNELS) return;
+    ChannelState& ch = channels[channel];
+    uint8_t order[LOG_SEGMENTS];
+    uint32_t sequences[LOG_SEGMENTS];
+    uint32_t counts[LOG_SEGMENTS];
+    lock();
+    flushChannel(ch);
+    uint8_t segments = orderedSegments(ch, order, sequences);
+    uint32_t total = countRecords(ch, order, segments, counts);
+    unlock();
+    if (total == 0) {
+        writeOutput("Журнал пуст\n");
+    } else {
+        printRecords(ch, order, sequences, counts, segments, total > count ? total - count : 0);
+    }
+}
+
+void logClear(LogChannel channel) {
+    if (!ready || channel >= LOG_CHANNELS) return;
+    ChannelState& ch = channels[channel];
+    lock();
+    char path[32];
+    for (uint8_t i = 0; i < LOG_SEGMENTS; i++) {
+        segmentPath(ch, i, path, sizeof(path));
+        if (LittleFS.exists(path)) LittleFS.remove(path);
+    }
+    ch.segment = 0;
+    ch.sequence = 0;
+    ch.size = 0;
+    ch.pending = 0;
+    unlock();
+}
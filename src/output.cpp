@@ -0,0 +1,122 @@
+#include "output.h"
+#include <atomic>
+
+#if !defined(ARDUINO_ARCH_ESP32)
+#include <chrono>
+#include <thread>
+#endif
+
+static_assert((OUTPUT_BUFFER_SIZE & (OUTPUT_BUFFER_SIZE - 1)) == 0, "Ёмкость буфера вывода должна быть степенью двойки");
+
+static char ring[OUTPUT_BUFFER_SIZE];
+static std::atomic<uint32_t> head{0};   // Следующий байт для записи получателю (двигает задача вывода)
+static std::atomic<uint32_t> tail{0};   // Следующее свободное место (двигает консоль)
+static std::atomic<bool> started{false};
+// Меняется только при пустом буфере, поэтому задача вывода читает его без гонок
+static fs::File* target = nullptr;
+
+static void writeTarget(const char* data, size_t length) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    if (target) {
+        target->write(bytes, length);
+    } else {
+        Serial.write(bytes, length);
+    }
+}
+
+// ---- Платформенная часть: задача вывода, ожидание и пробуждение ----
+
+static void flusherLoop();
+
+#if defined(ARDUINO_ARCH_ESP32)
+static TaskHandle_t flusher = nullptr;
+
+static void flusherTask(void*) {
+    flusherLoop();
+}
+
+static bool startTask() {
+    return xTaskCreate(flusherTask, "output", OUTPUT_STACK_SIZE, nullptr,
+                       OUTPUT_PRIORITY, &flusher) == pdPASS;
+}
+
+static void waitData()   { ulTaskNotifyTake(pdTRUE, portMAX_DELAY); }
+static void wakeFlusher() { xTaskNotifyGive(flusher); }
+static void waitSpace()  { vTaskDelay(1); }
+#else
+static bool startTask() {
+    std::thread(flusherLoop).detach();
+    return true;
+}
+
+static void waitData()   { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+static void wakeFlusher() {}
+static void waitSpace()  { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+#endif
+
+// ---- Задача вывода ----
+
+static void flusherLoop() {
+    while (true) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+        if (h == t) {
+            waitData();
+            continue;
+        }
+        // Непрерывный участок: до конца буфера, до tail и не больше одной пачки
+        uint32_t offset = h & (OUTPUT_BUFFER_SIZE - 1);
+        size_t length = min<size_t>(t - h, OUTPUT_BUFFER_SIZE - offset);
+        length = min<size_t>(length, OUTPUT_CHUNK_SIZE);
+        writeTarget(ring + offset, length);
+        // Место освобождается только после записи: outputFlush() ждёт именно этого
+        head.store(h + length, std::memory_order_release);
+    }
+}
+
+// ---- Сторона консоли ----
+
+bool outputBegin() {
+#if OUTPUT_ASYNC
+    if (started.load()) return true;
+    if (!startTask()) return false;
+    started.store(true);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void outputWrite(const char* data, size_t length) {
+    if (!started.load(std::memory_order_relaxed)) {
+        writeTarget(data, length);
+        return;
+    }
+    while (length > 0) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t space = OUTPUT_BUFFER_SIZE - (t - head.load(std::memory_order_acquire));
+        if (space == 0) {
+            waitSpace();
+            continue;
+        }
+        uint32_t offset = t & (OUTPUT_BUFFER_SIZE - 1);
+        size_t chunk = min<size_t>(length, min<size_t>(space, OUTPUT_BUFFER_SIZE - offset));
+        memcpy(ring + offset, data, chunk);
+        tail.store(t + chunk, std::memory_order_release);
+        wakeFlusher();
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void outputFlush() {
+    if (!started.load(std::memory_order_relaxed)) return;
+    while (head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed)) {
+        waitSpace();
+    }
+}
+
+void outputRedirect(fs::File* file) {
+    outputFlush();
+    target = file;
+}
@@ -0,0 +1,192 @@
+#include "peephole.h"
+#include "vm.h"
+
+// Длина инструкций окна; 0 — инструкция заканчивает окно
+static uint8_t instrBytes(uint8_t opcode) {
+    switch (opcode) {
+        case OP_LOAD:
+        case OP_STORE:
+        case OP_LDW:
+        case OP_STW:  return 6;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_CMP:  return 4;
+        case OP_PUSH:
+        case OP_POP:  return 2;
+        default:      return 0;
+    }
+}
+
+bool peepholeCandidate(uint8_t opcode) {
+    return instrBytes(opcode) != 0;
+}
+
+static inline bool isArith(uint8_t opcode) {
+    return opcode == OP_ADD || opcode == OP_SUB || opcode == OP_MUL || opcode == OP_DIV || opcode == OP_CMP;
+}
+
+// Регистр, в который пишет инструкция (NUM_REGS — не пишет)
+static uint8_t writtenReg(const PeepholeInstr& ins) {
+    if (ins.opcode == OP_LOAD || ins.opcode == OP_LDW || ins.opcode == OP_POP || isArith(ins.opcode)) {
+        return ins.regs[0];
+    }
+    return NUM_REGS;
+}
+
+// Маска читаемых регистров
+static uint32_t readRegs(const PeepholeInstr& ins) {
+    if (isArith(ins.opcode)) return (1u << ins.regs[1]) | (1u << ins.regs[2]);
+    if (ins.opcode == OP_STORE || ins.opcode == OP_STW || ins.opcode == OP_PUSH) return 1u << ins.regs[0];
+    return 0;
+}
+
+// Инструкции без побочных эффектов: div может упасть на нуле, pop двигает стек
+static inline bool removable(const PeepholeInstr& ins) {
+    return ins.opcode == OP_LOAD || (isArith(ins.opcode) && ins.opcode != OP_DIV);
+}
+
+// Результат арифметики так же, как в VirtualMachine::run (делитель не ноль)
+static uint32_t compute(uint8_t opcode, uint32_t a, uint32_t b) {
+    switch (opcode) {
+        case OP_ADD: return a + b;
+        case OP_SUB: return a - b;
+        case OP_MUL: return a * b;
+        case OP_DIV: return a / b;
+        default:     return a == b ? 0 : (a > b ? 1 : 0xFFFFFFFF);
+    }
+}
+
+enum Simplify : uint8_t {
+    SIMPLIFY_NONE,
+    SIMPLIFY_CHANGED,
+    SIMPLIFY_REMOVE,         // Тождество: регистр назначения не меняется
+};
+
+static Simplify simplify(PeepholeInstr& ins, const bool* known, const uint32_t* value) {
+    uint8_t d = ins.regs[0], a = ins.regs[1], b = ins.regs[2];
+    bool knownA = known[a], knownB = known[b];
+    switch (ins.opcode) {
+        case OP_MUL:
+            if ((knownB && value[b] == 2) || (knownA && value[a] == 2)) {
+                uint8_t other = knownB && value[b] == 2 ? a : b;
+                ins.opcode = OP_ADD;
+                ins.regs[1] = ins.regs[2] = other;
+                return SIMPLIFY_CHANGED;
+            }
+            if ((knownB && value[b] == 1 && d == a) || (knownA && value[a] == 1 && d == b)) return SIMPLIFY_REMOVE;
+            break;
+        case OP_DIV:
+            if (knownB && value[b] == 1 && d == a) return SIMPLIFY_REMOVE;
+            break;
+        case OP_ADD:
+            if ((knownB && value[b] == 0 && d == a) || (knownA && value[a] == 0 && d == b)) return SIMPLIFY_REMOVE;
+            break;
+        case OP_SUB:
+            if (knownB && value[b] == 0 && d == a) return SIMPLIFY_REMOVE;
+            break;
+    }
+    return SIMPLIFY_NONE;
+}
+
+struct Variant {
+    PeepholeInstr ins[PEEPHOLE_WINDOW];
+    bool removed[PEEPHOLE_WINDOW];
+    size_t count;
+    uint32_t bytes;
+    PeepholeStats stats;
+};
+
+// Один вариант оптимизации окна: со свёрткой констант или без неё
+static void runVariant(const PeepholeInstr* window, size_t count, bool fold, Variant& v) {
+    memset(&v.stats, 0, sizeof(v.stats));
+    bool known[NUM_REGS] = {};
+    uint32_t value[NUM_REGS] = {};
+    int last = -1;           // Последняя оставшаяся инструкция — для пары push/pop
+
+    for (size_t i = 0; i < count; i++) {
+        PeepholeInstr ins = window[i];
+        bool drop = false;
+        uint8_t d = ins.regs[0];
+        if (ins.opcode == OP_POP && last >= 0 && v.ins[last].opcode == OP_PUSH && v.ins[last].regs[0] == d) {
+            v.removed[last] = true;
+            drop = true;
+            v.stats.pushPop++;
+        } else if (ins.opcode == OP_LOAD) {
+            known[d] = ins.known;
+            value[d] = ins.value;
+        } else if (isArith(ins.opcode)) {
+            uint8_t a = ins.regs[1], b = ins.regs[2];
+            bool constant = known[a] && known[b] && !(ins.opcode == OP_DIV && value[b] == 0);
+            uint32_t result = constant ? compute(ins.opcode, value[a], value[b]) : 0;
+            if (constant && fold) {
+                ins.opcode = OP_LOAD;
+                ins.value = result;
+                ins.known = true;
+                v.stats.folded++;
+            } else {
+                Simplify s = simplify(ins, known, value);
+                if (s != SIMPLIFY_NONE) v.stats.simplified++;
+                drop = s == SIMPLIFY_REMOVE;
+            }
+            if (!drop) {
+                known[d] = constant;
+                value[d] = result;
+            }
+        } else if (ins.opcode == OP_LDW || ins.opcode == OP_POP) {
+            known[d] = false;
+        }
+        v.ins[i] = ins;
+        v.removed[i] = drop;
+        if (!drop) {
+            last = i;
+        } else {
+            while (last >= 0 && v.removed[last]) last--;
+        }
+    }
+
+    // Мёртвые записи: обратный проход, на выходе из окна все регистры живы
+    uint32_t live = (1u << NUM_REGS) - 1;
+    for (size_t i = count; i-- > 0;) {
+        if (v.removed[i]) continue;
+        uint8_t w = writtenReg(v.ins[i]);
+        if (w < NUM_REGS && !(live & (1u << w)) && removable(v.ins[i])) {
+            v.removed[i] = true;
+            v.stats.deadStores++;
+            continue;
+        }
+        if (w < NUM_REGS) live &= ~(1u << w);
+        live |= readRegs(v.ins[i]);
+    }
+
+    v.count = 0;
+    v.bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (v.removed[i]) continue;
+        v.bytes += instrBytes(v.ins[i].opcode);
+        v.ins[v.count++] = v.ins[i];
+    }
+}
+
+size_t optimizeWindow(PeepholeInstr* window, size_t count, PeepholeStats& stats) {
+    if (count > PEEPHOLE_WINDOW) count = PEEPHOLE_WINDOW;
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < count; i++) bytes += instrBytes(window[i].opcode);
+
+    // load длиннее арифметики: свёртка выгодна, только если освобождённые load удаляются
+    Variant plain, folded;
+    runVariant(window, count, false, plain);
+    runVariant(window, count, true, folded);
+    const Variant& best = folded.bytes < plain.bytes ||
+                          (folded.bytes == plain.bytes && folded.count <= plain.count) ? folded : plain;
+
+    memcpy(window, best.ins, best.count * sizeof(PeepholeInstr));
+    stats.folded += best.stats.folded;
+    stats.deadStores += best.stats.deadStores;
+    stats.pushPop += best.stats.pushPop;
+    stats.simplified += best.stats.simplified;
+    stats.removed += count - best.count;
+    stats.bytesSaved += bytes - best.bytes;
+    return best.count;
+}
@@ -0,0 +1,78 @@
+#include "pipeline.h"
+#include "output.h"
+#include <commands/utils.h>
+
+static PipeFilter* input = nullptr;   // Первый фильтр подключённого конвейера
+
+void PipeFilter::emit(const char* data, size_t length) {
+    if (length == 0) return;
+    if (next) {
+        if (!next->closed()) next->write(data, length);
+    } else if (toConsole) {
+        if (!outer) {
+            outputWrite(data, length);
+        } else if (!outer->closed()) {
+            outer->write(data, length);
+        }
+    } else {
+        writeOutput(data, length);
+    }
+}
+
+void LineFilter::write(const char* data, size_t length) {
+    while (length > 0) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', length));
+        size_t chunk = newline ? newline - data + 1 : length;
+        // Целая строка без накопленного начала обрабатывается без копирования
+        if (newline && used == 0 && chunk <= sizeof(buffer)) {
+            line(data, chunk);
+        } else {
+            size_t room = sizeof(buffer) - used;
+            size_t part = min(chunk, room);
+            memcpy(buffer + used, data, part);
+            used += part;
+            chunk = part;
+            if (used == sizeof(buffer) || buffer[used - 1] == '\n') {
+                line(buffer, used);
+                used = 0;
+            }
+        }
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void LineFilter::finish() {
+    if (used > 0) {
+        line(buffer, used);
+        used = 0;
+    }
+}
+
+PipeFilter* pipeBegin(PipeFilter* first) {
+    PipeFilter* outer = input;
+    PipeFilter* last = first;
+    while (last->next) last = last->next;
+    last->toConsole = true;
+    last->outer = outer;
+    input = first;
+    return outer;
+}
+
+void pipeEnd(PipeFilter* outer) {
+    PipeFilter* filter = input;
+    input = outer;
+    for (; filter; filter = filter->next) {
+        filter->finish();
+    }
+}
+
+bool pipeWrite(const char* data, size_t length) {
+    if (!input) return false;
+    if (!input->closed()) input->write(data, length);
+    return true;
+}
+
+bool pipeClosed() {
+    return input && input->closed();
+}
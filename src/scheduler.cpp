@@ -0,0 +1,115 @@
+#include "scheduler.h"
+#include <commands/utils.h>
+#include "log.h"
+#include <new>
+
+Scheduler scheduler;
+
+int32_t Scheduler::spawn(File& file, const String& name) {
+    int32_t free = -1;
+    for (uint8_t i = 0; i < SCHED_MAX_TASKS; i++) {
+        if (!tasks[i].used) {
+            free = i;
+            break;
+        }
+    }
+    if (free < 0) return SCHED_ERR_NO_SLOT;
+
+    VmTask& task = tasks[free];
+    snprintf(task.stateFile, sizeof(task.stateFile), "/system/task%d.dat", (int)free);
+    task.vm = new (std::nothrow) VirtualMachine(task.stateFile);
+    if (!task.vm) return SCHED_ERR_NO_MEMORY;
+    if (!task.vm->loadProgram(file)) {
+        delete task.vm;
+        task.vm = nullptr;
+        return SCHED_ERR_PROGRAM;
+    }
+    task.vm->setOutputHandler(programOutput ? programOutput : writeProgramOutput, nullptr);
+    task.used = true;
+    task.id = nextId++;
+    task.name = name;
+    task.slices = 0;
+    return task.id;
+}
+
+bool Scheduler::kill(uint16_t id) {
+    for (VmTask& task : tasks) {
+        if (task.used && task.id == id) {
+            finish(task, "killed");
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::tick() {
+    for (uint8_t n = 0; n < SCHED_MAX_TASKS; n++) {
+        VmTask& task = tasks[(cursor + n) % SCHED_MAX_TASKS];
+        if (!task.used) continue;
+        task.vm->run(SCHED_SLICE_BUDGET);
+        task.slices++;
+        if (!task.vm->isRunning()) {
+            finish(task, "done");
+        }
+    }
+    cursor = (cursor + 1) % SCHED_MAX_TASKS;
+}
+
+uint32_t Scheduler::count() const {
+    uint32_t used = 0;
+    for (const VmTask& task : tasks) {
+        if (task.used) used++;
+    }
+    return used;
+}
+
+// Отчёт о завершении и освобождение ВМ
+void Scheduler::finish(VmTask& task, const char* reason) {
+    String line = "[" + String(task.id) + "] " + reason + ": " + task.name +
+                  " (" + String(task.vm->instructionCount()) + " instructions)";
+    const VmFault& fault = task.vm->fault();
+    if (fault.code != FAULT_NONE) {
+        char details[64];
+        snprintf(details, sizeof(details), ", fault: %s at 0x%04X",
+                 faultName(fault.code), (unsigned)fault.pc);
+        line += details;
+        logMessage(LOG_ERROR, "vm", "[%u] %s: %s at 0x%04X", (unsigned)task.id, task.name.c_str(),
+                   faultName(fault.code), (unsigned)fault.pc);
+    }
+    line += "\n";
+    if (reporter) {
+        reporter(line);
+    } else {
+        writeOutput(line);
+    }
+    delete task.vm;
+    task.vm = nullptr;
+    task.used = false;
+    task.name = "";
+}
+
+String Scheduler::listing() const {
+    if (count() == 0) {
+        return "No background programs\n";
+    }
+    String text = column("id", 6) + column("instructions", 14) + column("slices", 10) + "program\n";
+    for (const VmTask& task : tasks) {
+        if (!task.used) continue;
+        text += column(String(task.id), 6) + column(String(task.vm->instructionCount()), 14) +
+                column(String(task.slices), 10) + task.name + "\n";
+    }
+    return text;
+}
+
+String spawnMessage(int32_t result, const String& name) {
+    switch (result) {
+        case SCHED_ERR_NO_SLOT:
+            return "Too many background programs (max " + String(SCHED_MAX_TASKS) + ")\n";
+        case SCHED_ERR_NO_MEMORY:
+            return "Not enough memory for VM\n";
+        case SCHED_ERR_PROGRAM:
+            return "Invalid or unreadable program: " + name + "\n";
+        default:
+            return "[" + String(result) + "] " + name + "\n";
+    }
+}
@@ -0,0 +1,177 @@
+#include "script_cache.h"
+#include "console.h"
+#include "tokenizer.h"
+#include <commands/utils.h>
+#include <LittleFS.h>
+
+struct ScriptCacheHeader {
+    char magic[4];
+    uint32_t sourceSize;
+    uint32_t sourceTime;     // getLastWrite() исходника
+    uint32_t tableHash;      // commandTableHash() на момент сборки
+};
+
+enum ScriptRecordKind : uint8_t {
+    SCRIPT_PARSED = 1,       // Готовые argv (и файл перенаправления)
+    SCRIPT_TEXT   = 2,       // Исходный текст строки, разбирается при исполнении
+};
+
+#define SCRIPT_REDIRECT  0x01
+#define SCRIPT_APPEND    0x02
+#define SCRIPT_UNKNOWN   0xFF   // Номер неизвестной команды
+
+// Заголовок записи; за ним length байт: строки argv и файла перенаправления (с нулями)
+// или текст строки (с нулём). length не больше COMMAND_LINE_MAX.
+struct ScriptRecord {
+    uint8_t kind;
+    uint8_t command;
+    uint8_t argc;
+    uint8_t flags;
+    uint16_t length;
+};
+
+// ---- Сборка ----
+
+static bool writeRecord(fs::File& cache, const ScriptRecord& record, const char* payload) {
+    return cache.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record) &&
+           cache.write(reinterpret_cast<const uint8_t*>(payload), record.length) == record.length;
+}
+
+static bool compileLine(fs::File& cache, const String& text, CommandLine& line) {
+    int index = lookupCommand(text.c_str());
+    TokenizeStatus status = tokenize(text.c_str(), line, commandRawFrom(index));
+    if (status == TOKENIZE_EMPTY) return true;
+
+    // Подстановки, конвейеры и ошибки разбора повторяются при каждом запуске как есть
+    if (status != TOKENIZE_OK || line.expanded || line.stages > 1) {
+        if (text.length() + 1 > COMMAND_LINE_MAX) return false;
+        ScriptRecord record = {SCRIPT_TEXT, SCRIPT_UNKNOWN, 0, 0, (uint16_t)(text.length() + 1)};
+        return writeRecord(cache, record, text.c_str());
+    }
+
+    // Слова копируются подряд: остаток строки (rawFrom) может указывать не в scratch, а в text
+    char payload[COMMAND_LINE_MAX];
+    size_t length = 0;
+    for (int i = 0; i <= line.argc; i++) {
+        const char* word = i < line.argc ? line.argv[i] : line.redirect;
+        if (!word) break;
+        size_t size = strlen(word) + 1;
+        if (length + size > sizeof(payload)) return false;
+        memcpy(payload + length, word, size);
+        length += size;
+    }
+    ScriptRecord record = {
+        SCRIPT_PARSED,
+        (uint8_t)(index >= 0 ? index : SCRIPT_UNKNOWN),
+        (uint8_t)line.argc,
+        (uint8_t)((line.redirect ? SCRIPT_REDIRECT : 0) | (line.append ? SCRIPT_APPEND : 0)),
+        (uint16_t)length
+    };
+    return writeRecord(cache, record, payload);
+}
+
+static bool compileScript(fs::File& source, const String& cachePath, const ScriptCacheHeader& header) {
+    fs::File cache = LittleFS.open(cachePath, FILE_WRITE);
+    if (!cache) return false;
+    // Заголовок пишется пустым и заполняется в конце: недописанный кэш не пройдёт проверку
+    ScriptCacheHeader blank = {};
+    bool ok = cache.write(reinterpret_cast<const uint8_t*>(&blank), sizeof(blank)) == sizeof(blank);
+    CommandLine line;
+    while (ok && source.available()) {
+        String text = source.readStringUntil('\n');
+        text.trim();
+        if (text.length() > 0) ok = compileLine(cache, text, line);
+    }
+    ok = ok && cache.seek(0) &&
+         cache.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    cache.close();
+    if (!ok) LittleFS.remove(cachePath);
+    return ok;
+}
+
+// ---- Исполнение ----
+
+static bool validCache(fs::File& cache, const ScriptCacheHeader& expected) {
+    ScriptCacheHeader header;
+    return cache && cache.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+           memcmp(&header, &expected, sizeof(header)) == 0;
+}
+
+// Восстановление CommandLine из записи, прочитанной в line.scratch
+static bool unpackRecord(const ScriptRecord& record, CommandLine& line) {
+    const char* p = line.scratch;
+    const char* end = line.scratch + record.length;
+    int words = record.argc + ((record.flags & SCRIPT_REDIRECT) ? 1 : 0);
+    if (record.argc == 0 || record.argc > COMMAND_MAX_ARGS) return false;
+    for (int i = 0; i < words; i++) {
+        const char* zero = static_cast<const char*>(memchr(p, 0, end - p));
+        if (!zero) return false;
+        if (i < record.argc) line.argv[i] = p;
+        else line.redirect = p;
+        p = zero + 1;
+    }
+    line.argc = record.argc;
+    line.argv[line.argc] = nullptr;
+    line.stages = 1;
+    line.stageStart[0] = 0;
+    line.stageLength[0] = record.argc;
+    if (!(record.flags & SCRIPT_REDIRECT)) line.redirect = nullptr;
+    line.append = record.flags & SCRIPT_APPEND;
+    line.expanded = false;
+    return true;
+}
+
+// false — команда завершилась ошибкой или кэш повреждён
+static bool replayScript(fs::File& cache) {
+    CommandLine line;
+    ScriptRecord record;
+    while (cache.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record)) {
+        if (record.length == 0 || record.length > sizeof(line.scratch) ||
+            cache.read(reinterpret_cast<uint8_t*>(line.scratch), record.length) != record.length ||
+            line.scratch[record.length - 1] != 0) {
+            writeOutput("Кэш скрипта повреждён\n");
+            return false;
+        }
+        if (record.kind == SCRIPT_TEXT) {
+            handleCommand(line.scratch);
+        } else if (record.kind == SCRIPT_PARSED && unpackRecord(record, line)) {
+            executeCommand(record.command == SCRIPT_UNKNOWN ? -1 : record.command, line);
+        } else {
+            writeOutput("Кэш скрипта повреждён\n");
+            return false;
+        }
+        if (lastCommandFailed()) return false;
+    }
+    return true;
+}
+
+bool runCachedScript(const String& path, bool& ok) {
+    fs::File source = LittleFS.open(path);
+    if (!source) return false;
+    ScriptCacheHeader header;
+    memcpy(header.magic, SCRIPT_CACHE_MAGIC, sizeof(header.magic));
+    header.sourceSize = source.size();
+    header.sourceTime = (uint32_t)source.getLastWrite();
+    header.tableHash = commandTableHash();
+    // Без времени записи изменение скрипта того же размера не заметить
+    if (header.sourceTime == 0) {
+        source.close();
+        return false;
+    }
+
+    String cachePath = path + SCRIPT_CACHE_SUFFIX;
+    fs::File cache = LittleFS.open(cachePath, FILE_READ);
+    if (!validCache(cache, header)) {
+        if (cache) cache.close();
+        bool compiled = compileScript(source, cachePath, header);
+        source.close();
+        if (!compiled) return false;
+        cache = LittleFS.open(cachePath, FILE_READ);
+        if (!validCache(cache, header)) return false;
+    } else {
+        source.close();
+    }
+    ok = replayScript(cache);
+    cache.close();
+    return true;
+}
@@ -0,0 +1,194 @@
+#include "tokenizer.h"
+#include "commands/environment.h"
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool isNameChar(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Запись слов в буфер с контролем переполнения (последний байт — под завершающий ноль)
+struct ScratchWriter {
+    char* pos;
+    char* end;
+    bool overflow;
+    bool expanded;
+
+    void put(char c) {
+        if (pos < end - 1) *pos++ = c;
+        else overflow = true;
+    }
+
+    void put(const char* text, size_t length) {
+        while (length--) put(*text++);
+    }
+};
+
+// Экранированный символ после '\'; 0 — последовательность не распознана
+static char escaped(char c) {
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '\\': case '$': case '"': case '\'':
+        case ' ': case '>': case '#':
+            return c;
+        default: return 0;
+    }
+}
+
+// Подстановка $VAR / ${VAR}; p указывает на '$'. Возвращает позицию после подстановки
+// или nullptr для незакрытой ${
+static const char* expand(const char* p, ScratchWriter& out) {
+    const char* name = p + 1;
+    bool braces = *name == '{';
+    if (braces) name++;
+    const char* end = name;
+    while (isNameChar(*end)) end++;
+    if (braces) {
+        if (*end != '}') return nullptr;
+    } else if (end == name) {
+        out.put('$');           // Одиночный '$' остаётся как есть
+        return p + 1;
+    }
+    out.expanded = true;
+    const String* value = findEnvVar(name, end - name);
+    if (value) out.put(value->c_str(), value->length());
+    return braces ? end + 1 : end;
+}
+
+TokenizeStatus tokenize(const char* line, CommandLine& out, uint8_t rawFrom) {
+    ScratchWriter writer = {out.scratch, out.scratch + sizeof(out.scratch), false, false};
+    uint8_t count = 0;         // Занято ячеек argv (слова и разделители команд)
+    uint8_t stage = 0;
+    out.argc = 0;
+    out.argv[0] = nullptr;
+    out.stages = 1;
+    out.stageStart[0] = 0;
+    out.stageLength[0] = 0;
+    out.redirect = nullptr;
+    out.append = false;
+    out.expanded = false;
+    bool toRedirect = false;   // Следующее слово — имя файла перенаправления
+    const char* p = line;
+
+    while (true) {
+        while (isBlank(*p)) p++;
+        if (*p == 0 || *p == '#') break;
+
+        if (*p == '|') {
+            if (toRedirect) return TOKENIZE_NO_TARGET;
+            if (out.stageLength[stage] == 0) return TOKENIZE_EMPTY_STAGE;
+            if (stage + 1 == COMMAND_MAX_STAGES) return TOKENIZE_TOO_MANY_STAGES;
+            out.argv[count++] = nullptr;
+            stage++;
+            out.stages++;
+            out.stageStart[stage] = count;
+            out.stageLength[stage] = 0;
+            p++;
+            continue;
+        }
+
+        if (*p == '>') {
+            if (toRedirect) return TOKENIZE_NO_TARGET;
+            out.append = p[1] == '>';
+            p += out.append ? 2 : 1;
+            toRedirect = true;
+            continue;
+        }
+
+        // Остаток строки одним аргументом: без копирования, если он идёт до конца строки
+        if (!toRedirect && rawFrom > 0 && stage == 0 && out.stageLength[0] == rawFrom) {
+            if (count >= COMMAND_MAX_ARGS + stage) return TOKENIZE_TOO_MANY;
+            const char* stop = strpbrk(p, ">|");
+            const char* end = stop ? stop : p + strlen(p);
+            while (end > p && isBlank(end[-1])) end--;
+            if (*end == 0) {
+                out.argv[count++] = p;
+            } else {
+                out.argv[count++] = writer.pos;
+                writer.put(p, end - p);
+                writer.put('\0');
+            }
+            out.stageLength[0]++;
+            p = stop ? stop : end + strlen(end);
+            continue;
+        }
+
+        char* word = writer.pos;
+        while (*p && !isBlank(*p) && *p != '>' && *p != '|') {
+            char c = *p;
+            if (c == '\'') {
+                const char* close = strchr(p + 1, '\'');
+                if (!close) return TOKENIZE_UNTERMINATED;
+                writer.put(p + 1, close - p - 1);
+                p = close + 1;
+            } else if (c == '"') {
+                p++;
+                while (*p != '"') {
+                    if (*p == 0) return TOKENIZE_UNTERMINATED;
+                    if (*p == '\\' && p[1] && escaped(p[1])) {
+                        writer.put(escaped(p[1]));
+                        p += 2;
+                    } else if (*p == '$') {
+                        p = expand(p, writer);
+                        if (!p) return TOKENIZE_UNTERMINATED;
+                    } else {
+                        writer.put(*p++);
+                    }
+                }
+                p++;
+            } else if (c == '\\') {
+                // Нераспознанная последовательность сохраняется вместе с '\'
+                char e = p[1] ? escaped(p[1]) : 0;
+                if (e) {
+                    writer.put(e);
+                    p += 2;
+                } else {
+                    writer.put(*p++);
+                }
+            } else if (c == '$') {
+                p = expand(p, writer);
+                if (!p) return TOKENIZE_UNTERMINATED;
+            } else {
+                writer.put(*p++);
+            }
+        }
+        writer.put('\0');
+        if (writer.overflow) return TOKENIZE_TOO_LONG;
+
+        if (toRedirect) {
+            out.redirect = word;
+            toRedirect = false;
+        } else {
+            // Слов не больше COMMAND_MAX_ARGS, разделители команд в лимит не входят
+            if (count >= COMMAND_MAX_ARGS + stage) return TOKENIZE_TOO_MANY;
+            out.argv[count++] = word;
+            out.stageLength[stage]++;
+        }
+    }
+
+    if (writer.overflow) return TOKENIZE_TOO_LONG;
+    if (toRedirect) return TOKENIZE_NO_TARGET;
+    if (stage > 0 && out.stageLength[stage] == 0) return TOKENIZE_EMPTY_STAGE;
+    out.argv[count] = nullptr;
+    out.argc = out.stageLength[0];
+    out.expanded = writer.expanded;
+    return out.argc > 0 ? TOKENIZE_OK : TOKENIZE_EMPTY;
+}
+
+const char* tokenizeError(TokenizeStatus status) {
+    switch (status) {
+        case TOKENIZE_OK:           return "";
+        case TOKENIZE_EMPTY:        return "";
+        case TOKENIZE_TOO_MANY:     return "Слишком много аргументов";
+        case TOKENIZE_TOO_LONG:     return "Слишком длинная строка";
+        case TOKENIZE_UNTERMINATED: return "Незакрытая кавычка или ${";
+        case TOKENIZE_NO_TARGET:    return "Не указан файл для перенаправления";
+        case TOKENIZE_EMPTY_STAGE:  return "Пустая команда в конвейере";
+        case TOKENIZE_TOO_MANY_STAGES: return "Слишком много команд в конвейере";
+    }
+    return "";
+}
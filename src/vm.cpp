@@ -1,10 +1,19 @@
 #include "vm.h"
+#include <new>
 
 // Конструктор: инициализирует ВМ и выполняет сброс
-VirtualMachine::VirtualMachine() {
+VirtualMachine::VirtualMachine(const char* stateFile) {
+    storage.storageFile = stateFile;
+    flushBlocks();
     reset();
 }
 
+VirtualMachine::~VirtualMachine() {
+    delete[] decoded;
+    delete[] decodedAddr;
+    delete profile;
+}
+
 // Сброс состояния ВМ (сброс регистров, PC, стека и восстановление памяти)
 void VirtualMachine::reset() {
     pc = 0;
@@ -14,12 +23,13 @@ void VirtualMachine::reset() {
     memset(stack, 0, sizeof(stack));
     storage.init();
     storage.restore();
+    flushBlocks();
 }
 
 // Чтение 32-битного значения из памяти (big-endian)
 uint32_t VirtualMachine::read32(uint32_t address) {
-    if (address + 3 >= MEM_SIZE) {
-        Serial.printf("read32: Address 0x%04X out of bounds\n", address);
+    if (address > MEM_SIZE - 4) {
+        raiseFault(FAULT_BAD_ADDRESS, instrAddress, address);
         return 0;
     }
     return (storage.read(address) << 24) |
@@ -30,8 +40,8 @@ uint32_t VirtualMachine::read32(uint32_t address) {
 
 // Запись 32-битного значения в память (big-endian)
 void VirtualMachine::write32(uint32_t address, uint32_t value) {
-    if (address + 3 >= MEM_SIZE) {
-        Serial.printf("write32: Address 0x%04X out of bounds\n", address);
+    if (address > MEM_SIZE - 4) {
+        raiseFault(FAULT_BAD_ADDRESS, instrAddress, address);
         return;
     }
     storage.write(address,     (value >> 24) & 0xFF);
@@ -40,19 +50,533 @@ void VirtualMachine::write32(uint32_t address, uint32_t value) {
     storage.write(address + 3,  value & 0xFF);
 }
 
+// Проверка заголовка образа с сегментами (см. vm.h); total — полный размер образа
+static bool parseImageHeader(const uint8_t* header, size_t total,
+                             uint32_t& codeSize, uint32_t& rodataSize, uint32_t& dataSize) {
+    if (total < IMAGE_HEADER_SIZE || header[4] != IMAGE_VERSION) return false;
+    codeSize   = (header[8] << 8) | header[9];
+    rodataSize = (header[10] << 8) | header[11];
+    dataSize   = (header[12] << 8) | header[13];
+    return codeSize <= MEM_SIZE &&
+           rodataSize % 4 == 0 && dataSize % 4 == 0 &&
+           rodataSize + dataSize <= DATA_SIZE &&
+           IMAGE_HEADER_SIZE + codeSize + rodataSize + dataSize == total;
+}
+
+static bool isImage(const uint8_t* program, size_t size) {
+    return size >= 4 && memcmp(program, IMAGE_MAGIC, 4) == 0;
+}
+
+// Чтение length байт из файла блоками по PROGRAM_LOAD_CHUNK
+static bool readChunks(File& file, uint8_t* dest, size_t length) {
+    size_t loaded = 0;
+    while (loaded < length) {
+        size_t chunk = min(length - loaded, static_cast<size_t>(PROGRAM_LOAD_CHUNK));
+        size_t got = file.read(dest + loaded, chunk);
+        if (got == 0) return false;
+        loaded += got;
+    }
+    return true;
+}
+
+// Адрес слова в сегменте данных: выровнен и в пределах сегмента (и вне rodata для записи)
+static inline bool dataReadable(uint32_t address) {
+    return address < DATA_SIZE && (address & 3) == 0;
+}
+
+static inline bool dataWritable(uint32_t address, uint32_t rodataEnd) {
+    return dataReadable(address) && address >= rodataEnd;
+}
+
+// Чтение слова сегмента данных (адрес в байтах, кратен 4)
+uint32_t VirtualMachine::loadWord(uint32_t address) {
+    if (!dataReadable(address)) {
+        raiseFault(FAULT_BAD_ADDRESS, instrAddress, address);
+        return 0;
+    }
+    return storage.data[address / 4];
+}
+
+// Запись слова сегмента данных; rodata только для чтения
+void VirtualMachine::storeWord(uint32_t address, uint32_t value) {
+    if (!dataReadable(address)) {
+        raiseFault(FAULT_BAD_ADDRESS, instrAddress, address);
+    } else if (address < rodataEnd) {
+        raiseFault(FAULT_READONLY, instrAddress, address);
+    } else {
+        storage.data[address / 4] = value;
+        storage.markDataWord(address / 4);
+    }
+}
+
 // Загрузка программы в память ВМ
-void VirtualMachine::loadProgram(const uint8_t* program, size_t size) {
-    size = min(size, static_cast<size_t>(MEM_SIZE)); // Ограничение размера программы размером памяти
-    for (uint32_t i = 0; i < size; i++) {
-        storage.write(i, program[i]);
+// Выполнение новой программы всегда начинается с адреса 0 и пустого стека
+bool VirtualMachine::loadProgram(const uint8_t* program, size_t size, bool predecode) {
+    if (isImage(program, size)) {
+        uint32_t codeSize, rodataSize, dataSize;
+        if (!parseImageHeader(program, size, codeSize, rodataSize, dataSize)) return false;
+        const uint8_t* segments = program + IMAGE_HEADER_SIZE;
+        memcpy(storage.ram, segments, codeSize);
+        memcpy(storage.data, segments + codeSize, rodataSize + dataSize);
+        applyImage(codeSize, rodataSize, dataSize);
+    } else {
+        size = min(size, static_cast<size_t>(MEM_SIZE)); // Ограничение размера программы размером памяти
+        memcpy(storage.ram, program, size);
+        storage.markDirty(0, size);
+        segmented = false;
+        rodataEnd = 0;
+        programBytes = size;
+    }
+    startProgram(predecode);
+    return true;
+}
+
+// Загрузка программы из файла: блоки читаются сразу в память ВМ, без промежуточного буфера.
+// Программа, которая не помещается в память, отклоняется до чтения, память ВМ при этом не меняется.
+bool VirtualMachine::loadProgram(File& file, bool predecode) {
+    size_t size = file.size();
+    if (size > IMAGE_MAX_SIZE) {
+        return false;
+    }
+    uint8_t header[IMAGE_HEADER_SIZE];
+    size_t headerBytes = file.read(header, min(size, static_cast<size_t>(IMAGE_HEADER_SIZE)));
+
+    bool ok;
+    if (isImage(header, headerBytes)) {
+        uint32_t codeSize, rodataSize, dataSize;
+        if (!parseImageHeader(header, size, codeSize, rodataSize, dataSize)) return false;
+        ok = readChunks(file, storage.ram, codeSize) &&
+             readChunks(file, reinterpret_cast<uint8_t*>(storage.data), rodataSize + dataSize);
+        if (ok) applyImage(codeSize, rodataSize, dataSize);
+    } else {
+        if (size > MEM_SIZE) return false;
+        memcpy(storage.ram, header, headerBytes);
+        ok = readChunks(file, storage.ram + headerBytes, size - headerBytes);
+        if (ok) {
+            storage.markDirty(0, size);
+            segmented = false;
+            rodataEnd = 0;
+            programBytes = size;
+        }
+    }
+    if (!ok) {
+        // Память частично перезаписана недочитанной программой: весь образ
+        // перечитывается из файла состояния, и в следующее сохранение она не попадёт
+        storage.markDirty(0, STORAGE_SIZE);
+        storage.restore();
+        flushBlocks();
+        running = false;
+        return false;
+    }
+    startProgram(predecode);
+    return true;
+}
+
+// Код — в памяти кода, rodata и data — в начале сегмента данных, остаток сегмента обнуляется
+void VirtualMachine::applyImage(uint32_t codeSize, uint32_t rodataSize, uint32_t dataSize) {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(storage.data);
+    memset(bytes + rodataSize + dataSize, 0, DATA_SIZE - rodataSize - dataSize);
+    storage.markDirty(0, codeSize);
+    storage.markDirty(MEM_SIZE, DATA_SIZE);
+    segmented = true;
+    rodataEnd = rodataSize;
+    programBytes = codeSize;
+}
+
+// Подготовка к исполнению только что загруженной программы
+void VirtualMachine::startProgram(bool predecode) {
+    pc = 0;
+    sp = STACK_SIZE - 1;
+    running = false;
+    executed = 0;
+    decodeEnabled = predecode;
+    flushBlocks();
+    if (decodeEnabled) {
+        predecodeProgram();
+    }
+}
+
+// Длина инструкции в байтах (0 — неизвестный опкод)
+static uint32_t instructionLength(uint8_t opcode) {
+    switch (opcode) {
+        case OP_HALT:
+        case OP_RET:     return 1;
+        case OP_JMP:
+        case OP_CALL:    return 5;
+        case OP_LOAD:
+        case OP_STORE:
+        case OP_LDW:
+        case OP_STW:
+        case OP_JZ:
+        case OP_JNZ:     return 6;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_CMP:     return 4;
+        case OP_PUSH:
+        case OP_POP:
+        case OP_SYSCALL: return 2;
+        default:         return 0;
+    }
+}
+
+// Инструкции, которыми заканчивается базовый блок
+static bool endsBlock(uint8_t opcode) {
+    return opcode == OP_HALT || opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ ||
+           opcode == OP_CALL || opcode == OP_RET;
+}
+
+// Сборка big-endian 32-битного значения без проверок границ
+static inline uint32_t be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+// Проверка инструкции перед декодированием. Некорректная инструкция превращается
+// в TRAP и исполняется интерпретатором байткода, который и сообщит об ошибке.
+bool VirtualMachine::checkInstruction(uint32_t address) const {
+    const uint8_t* p = storage.ram + address;
+    uint32_t length = instructionLength(p[0]);
+    if (length == 0 || address + length > MEM_SIZE) return false;
+
+    switch (p[0]) {
+        case OP_LOAD:
+        case OP_PUSH:
+        case OP_POP:
+            return p[1] < NUM_REGS;
+        case OP_STORE:
+            if (segmented) {
+                return p[1] < NUM_REGS && dataWritable(be32(p + 2), rodataEnd);
+            }
+            return p[1] < NUM_REGS && be32(p + 2) <= MEM_SIZE - 4;
+        case OP_LDW:
+            return p[1] < NUM_REGS && dataReadable(be32(p + 2));
+        case OP_STW:
+            return p[1] < NUM_REGS && dataWritable(be32(p + 2), rodataEnd);
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_CMP:
+            return p[1] < NUM_REGS && p[2] < NUM_REGS && p[3] < NUM_REGS;
+        case OP_JMP:
+        case OP_CALL:
+            return be32(p + 1) < MEM_SIZE;
+        case OP_JZ:
+        case OP_JNZ:
+            return p[1] < NUM_REGS && be32(p + 2) < MEM_SIZE;
+        default:
+            return true;
+    }
+}
+
+// Сброс кэша блоков (новая программа или запись в декодированный код)
+void VirtualMachine::flushBlocks() {
+    blockCount = 0;
+    decodedCount = 0;
+    codeLow = MEM_SIZE;
+    codeHigh = 0;
+    cacheEpoch++;
+    for (uint32_t i = 0; i < BLOCK_HASH_SIZE; i++) blockHash[i] = -1;
+}
+
+// Гарантирует место под count инструкций в пуле (пул растёт удвоением)
+bool VirtualMachine::reservePool(uint32_t count) {
+    if (decodedCount + count <= decodedCapacity) return true;
+    uint32_t capacity = decodedCapacity ? decodedCapacity : DECODE_POOL_MIN;
+    while (capacity < decodedCount + count) capacity *= 2;
+    if (capacity > DECODE_POOL_MAX) return false;
+
+    DecodedInstr* newDecoded = new (std::nothrow) DecodedInstr[capacity];
+    uint16_t* newAddr = new (std::nothrow) uint16_t[capacity];
+    if (!newDecoded || !newAddr) {
+        delete[] newDecoded;
+        delete[] newAddr;
+        return false;
+    }
+    if (decodedCount > 0) {
+        memcpy(newDecoded, decoded, decodedCount * sizeof(DecodedInstr));
+        memcpy(newAddr, decodedAddr, decodedCount * sizeof(uint16_t));
+    }
+    delete[] decoded;
+    delete[] decodedAddr;
+    decoded = newDecoded;
+    decodedAddr = newAddr;
+    decodedCapacity = capacity;
+    return true;
+}
+
+// Декодирование базового блока, начинающегося с address
+int32_t VirtualMachine::decodeBlock(uint32_t address) {
+    const uint8_t* code = storage.ram;
+
+    // Первый проход: граница блока и количество инструкций
+    uint32_t addr = address;
+    uint32_t count = 0;
+    while (true) {
+        count++;
+        if (!checkInstruction(addr) || endsBlock(code[addr])) break;
+        addr += instructionLength(code[addr]);
+    }
+
+    if (blockCount >= BLOCK_CACHE_SIZE || !reservePool(count)) {
+        flushBlocks();
+        if (!reservePool(count)) return -1;
+    }
+
+    // Второй проход: заполнение пула
+    Block& blk = blocks[blockCount];
+    blk.start = address;
+    blk.first = decodedCount;
+    blk.count = count;
+    blk.next[0] = blk.next[1] = -1;
+    blk.hits = 0;
+
+    addr = address;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* p = code + addr;
+        DecodedInstr& ins = decoded[decodedCount];
+        decodedAddr[decodedCount] = addr;
+        decodedCount++;
+        ins.a = ins.b = ins.c = 0;
+        ins.imm = 0;
+        if (!checkInstruction(addr)) {
+            ins.op = DOP_TRAP;
+            ins.imm = addr;
+            addr++;
+            break;
+        }
+        switch (p[0]) {
+            case OP_HALT:    ins.op = DOP_HALT; break;
+            case OP_LOAD:    ins.op = DOP_LOAD;  ins.a = p[1]; ins.imm = be32(p + 2); break;
+            case OP_STORE:
+                if (segmented) {
+                    ins.op = DOP_STW; ins.a = p[1]; ins.imm = be32(p + 2) / 4;
+                } else {
+                    ins.op = DOP_STORE; ins.a = p[1]; ins.imm = be32(p + 2);
+                }
+                break;
+            case OP_LDW:     ins.op = DOP_LDW; ins.a = p[1]; ins.imm = be32(p + 2) / 4; break;
+            case OP_STW:     ins.op = DOP_STW; ins.a = p[1]; ins.imm = be32(p + 2) / 4; break;
+            case OP_ADD:     ins.op = DOP_ADD; ins.a = p[1]; ins.b = p[2]; ins.c = p[3]; break;
+            case OP_SUB:     ins.op = DOP_SUB; ins.a = p[1]; ins.b = p[2]; ins.c = p[3]; break;
+            case OP_MUL:     ins.op = DOP_MUL; ins.a = p[1]; ins.b = p[2]; ins.c = p[3]; break;
+            case OP_DIV:     ins.op = DOP_DIV; ins.a = p[1]; ins.b = p[2]; ins.c = p[3]; break;
+            case OP_CMP:     ins.op = DOP_CMP; ins.a = p[1]; ins.b = p[2]; ins.c = p[3]; break;
+            case OP_PUSH:    ins.op = DOP_PUSH;    ins.a = p[1]; break;
+            case OP_POP:     ins.op = DOP_POP;     ins.a = p[1]; break;
+            case OP_SYSCALL: ins.op = DOP_SYSCALL; ins.a = p[1]; break;
+            case OP_JMP:     ins.op = DOP_JMP;  ins.imm = be32(p + 1); break;
+            case OP_CALL:    ins.op = DOP_CALL; ins.imm = be32(p + 1); break;
+            case OP_RET:     ins.op = DOP_RET; break;
+            case OP_JZ:      ins.op = DOP_JZ;  ins.a = p[1]; ins.imm = be32(p + 2); break;
+            case OP_JNZ:     ins.op = DOP_JNZ; ins.a = p[1]; ins.imm = be32(p + 2); break;
+        }
+        addr += instructionLength(p[0]);
+    }
+    blk.end = addr;
+    if (fusionEnabled && !profile) {
+        fuseBlock(blk);
+    }
+
+    codeLow = min(codeLow, address);
+    codeHigh = max(codeHigh, addr);
+
+    // Открытая адресация с линейным пробированием
+    uint32_t slot = (address * 2654435761u) & (BLOCK_HASH_SIZE - 1);
+    while (blockHash[slot] >= 0) slot = (slot + 1) & (BLOCK_HASH_SIZE - 1);
+    blockHash[slot] = blockCount;
+    return blockCount++;
+}
+
+// Таблица правил слияния. Более длинные последовательности идут первыми;
+// чтобы добавить суперинструкцию, достаточно дописать правило и обработчик в runDecoded().
+const VirtualMachine::FusionRule VirtualMachine::fusionRules[] = {
+    {3, {DOP_PUSH, DOP_PUSH, DOP_PUSH}, {OP_PUSH, OP_PUSH, OP_PUSH},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         *out = {DOP_PUSH3, in[0].a, in[1].a, in[2].a, 0};
+         return 1;
+     }},
+    {3, {DOP_POP, DOP_POP, DOP_POP}, {OP_POP, OP_POP, OP_POP},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         *out = {DOP_POP3, in[0].a, in[1].a, in[2].a, 0};
+         return 1;
+     }},
+    {2, {DOP_LOAD, DOP_ADD}, {OP_LOAD, OP_ADD},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         // Загруженный регистр должен быть слагаемым; сложение коммутативно
+         uint8_t other;
+         if (in[1].c == in[0].a) other = in[1].b;
+         else if (in[1].b == in[0].a) other = in[1].c;
+         else return 0;
+         *out = {DOP_LOAD_ADD, in[1].a, other, in[0].a, in[0].imm};
+         return 1;
+     }},
+    {2, {DOP_LOAD, DOP_SUB}, {OP_LOAD, OP_SUB},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         if (in[1].c != in[0].a) return 0;
+         *out = {DOP_LOAD_SUB, in[1].a, in[1].b, in[0].a, in[0].imm};
+         return 1;
+     }},
+    {2, {DOP_LOAD, DOP_STORE}, {OP_LOAD, OP_STORE},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         if (in[1].a != in[0].a) return 0;
+         out[0] = {DOP_LOAD_STORE, in[0].a, 0, 0, in[0].imm};
+         out[1] = in[1];   // Слот данных: адрес записи
+         return 2;
+     }},
+    {2, {DOP_PUSH, DOP_PUSH}, {OP_PUSH, OP_PUSH},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         *out = {DOP_PUSH2, in[0].a, in[1].a, 0, 0};
+         return 1;
+     }},
+    {2, {DOP_POP, DOP_POP}, {OP_POP, OP_POP},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         *out = {DOP_POP2, in[0].a, in[1].a, 0, 0};
+         return 1;
+     }},
+    {2, {DOP_SUB, DOP_JNZ}, {OP_SUB, OP_JNZ},
+     [](const DecodedInstr* in, DecodedInstr* out) -> uint32_t {
+         if (in[1].a != in[0].a) return 0;
+         *out = {DOP_SUB_JNZ, in[0].a, in[0].b, in[0].c, in[1].imm};
+         return 1;
+     }},
+};
+
+const uint32_t VirtualMachine::fusionRuleCount = sizeof(fusionRules) / sizeof(fusionRules[0]);
+
+// Слияние соседних инструкций блока в суперинструкции (сжатие блока на месте)
+void VirtualMachine::fuseBlock(Block& blk) {
+    DecodedInstr* ins = decoded + blk.first;
+    uint16_t* addr = decodedAddr + blk.first;
+    uint32_t read = 0;
+    uint32_t write = 0;
+    while (read < blk.count) {
+        DecodedInstr out[2] = {ins[read], ins[read]};
+        uint16_t outAddr[2] = {addr[read], addr[read]};
+        uint32_t consumed = 1;
+        uint32_t produced = 1;
+
+        for (uint32_t r = 0; r < fusionRuleCount; r++) {
+            const FusionRule& rule = fusionRules[r];
+            if (read + rule.length > blk.count) continue;
+            bool match = true;
+            for (uint32_t k = 0; k < rule.length; k++) {
+                if (ins[read + k].op != rule.ops[k]) { match = false; break; }
+            }
+            if (!match) continue;
+            uint32_t slots = rule.build(ins + read, out);
+            if (slots > 0) {
+                consumed = rule.length;
+                produced = slots;
+                outAddr[1] = addr[read + 1];
+                break;
+            }
+        }
+
+        for (uint32_t k = 0; k < produced; k++) {
+            ins[write + k] = out[k];
+            addr[write + k] = outAddr[k];
+        }
+        read += consumed;
+        write += produced;
+    }
+    decodedCount -= blk.count - write;
+    blk.count = write;
+}
+
+// Поиск блока в кэше по адресу начала (-1 — блока нет)
+int32_t VirtualMachine::findBlock(uint32_t address) const {
+    uint32_t slot = (address * 2654435761u) & (BLOCK_HASH_SIZE - 1);
+    while (blockHash[slot] >= 0) {
+        if (blocks[blockHash[slot]].start == address) return blockHash[slot];
+        slot = (slot + 1) & (BLOCK_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+// Поиск блока в кэше; при промахе блок декодируется
+int32_t VirtualMachine::enterBlock(uint32_t address) {
+    if (address >= MEM_SIZE) return -1; // Конец памяти: ошибку сообщит интерпретатор байткода
+    int32_t index = findBlock(address);
+    return (index >= 0) ? index : decodeBlock(address);
+}
+
+// Обход программы от адреса 0 по статически известным переходам: стоимость
+// декодирования платится один раз при загрузке, а не внутри run().
+// Блоки, достижимые только через RET или не поместившиеся в кэш, декодируются при исполнении.
+void VirtualMachine::predecodeProgram() {
+    uint16_t pending[PREDECODE_QUEUE];
+    uint32_t count = 0;
+    pending[count++] = 0;
+
+    while (count > 0 && blockCount < BLOCK_CACHE_SIZE) {
+        uint32_t address = pending[--count];
+        if (address >= MEM_SIZE || findBlock(address) >= 0) continue;
+
+        uint32_t epoch = cacheEpoch;
+        int32_t index = decodeBlock(address);
+        if (index < 0 || epoch != cacheEpoch) break;
+
+        const Block& blk = blocks[index];
+        const DecodedInstr& last = decoded[blk.first + blk.count - 1];
+        switch (last.op) {
+            case DOP_JZ:
+            case DOP_JNZ:
+            case DOP_SUB_JNZ:
+            case DOP_CALL:
+                if (count < PREDECODE_QUEUE) pending[count++] = blk.end;
+                if (count < PREDECODE_QUEUE) pending[count++] = last.imm;
+                break;
+            case DOP_JMP:
+                if (count < PREDECODE_QUEUE) pending[count++] = last.imm;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Запись в декодированный код означает самомодификацию: кэш блоков больше не актуален
+void VirtualMachine::touchMemory(uint32_t address, uint32_t length) {
+    if (blockCount > 0 && length > 0 && address < codeHigh && address + length > codeLow) {
+        flushBlocks();
+    }
+}
+
+// Основной цикл выполнения программы. budget > 0 — вернуть управление после
+// примерно budget инструкций (на границе блока); running при этом остаётся true,
+// и следующий вызов run() продолжает программу с того же места.
+void VirtualMachine::run(uint32_t budget) {
+    if (!running) {
+        lastFault = {};
+    }
+    stopAt = (budget > 0 && executed + budget > executed) ? executed + budget : UINT32_MAX;
+    uint32_t startPc = pc;
+    uint32_t startExecuted = executed;
+    if (decodeEnabled && pc < MEM_SIZE) {
+        runDecoded();
+    } else {
+        runSwitch();
+    }
+    if (running && pc == startPc && executed == startExecuted) {
+        raiseFault(FAULT_NO_PROGRESS, pc, pc, true);
     }
 }
 
-// Основной цикл выполнения программы
-void VirtualMachine::run() {
+// Переносимый движок: switch по опкоду, каждое чтение проверяет границы памяти
+void VirtualMachine::runSwitch(bool toBlockEnd) {
     running = true;
-    while (running && pc < MEM_SIZE) {
+    // Программа дошла до конца памяти на границе блока или при исчерпании бюджета
+    if (pc >= MEM_SIZE) {
+        raiseFault(FAULT_PC_END, pc, pc, true);
+        return;
+    }
+    while (running && pc < MEM_SIZE && executed < stopAt) {
+        instrAddress = pc;
         uint8_t opcode = storage.read(pc++);
+        executed++;
         switch (opcode) {
 
             // Загрузка константы в регистр: LOAD reg, <32-bit value>
@@ -62,20 +586,50 @@ void VirtualMachine::run() {
                 if (reg_num < NUM_REGS) {
                     reg[reg_num] = value;
                 } else {
-                    Serial.printf("LOAD: Invalid register number: %d\n", reg_num);
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
                 }
                 pc += 4;
                 break;
             }
 
             // Запись значения из регистра в память: STORE reg, <32-bit address>
+            // (в образе с сегментами — слово в сегмент данных)
             case OP_STORE: {
                 uint8_t reg_num = storage.read(pc++);
                 uint32_t address = read32(pc);
-                if (reg_num < NUM_REGS) {
+                if (reg_num >= NUM_REGS) {
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
+                } else if (segmented) {
+                    storeWord(address, reg[reg_num]);
+                } else {
                     write32(address, reg[reg_num]);
+                    touchMemory(address, 4);
+                }
+                pc += 4;
+                break;
+            }
+
+            // Слово из сегмента данных: LDW reg, <32-bit address>
+            case OP_LDW: {
+                uint8_t reg_num = storage.read(pc++);
+                uint32_t address = read32(pc);
+                if (reg_num < NUM_REGS) {
+                    reg[reg_num] = loadWord(address);
                 } else {
-                    Serial.printf("STORE: Invalid register number: %d\n", reg_num);
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
+                }
+                pc += 4;
+                break;
+            }
+
+            // Слово в сегмент данных: STW reg, <32-bit address>
+            case OP_STW: {
+                uint8_t reg_num = storage.read(pc++);
+                uint32_t address = read32(pc);
+                if (reg_num < NUM_REGS) {
+                    storeWord(address, reg[reg_num]);
+                } else {
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
                 }
                 pc += 4;
                 break;
@@ -89,7 +643,7 @@ void VirtualMachine::run() {
                 if (dst < NUM_REGS && src1 < NUM_REGS && src2 < NUM_REGS) {
                     reg[dst] = reg[src1] + reg[src2];
                 } else {
-                    Serial.println("ADD: Invalid register number");
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, max(dst, max(src1, src2)));
                 }
                 break;
             }
@@ -102,7 +656,7 @@ void VirtualMachine::run() {
                 if (dst < NUM_REGS && src1 < NUM_REGS && src2 < NUM_REGS) {
                     reg[dst] = reg[src1] - reg[src2];
                 } else {
-                    Serial.println("SUB: Invalid register number");
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, max(dst, max(src1, src2)));
                 }
                 break;
             }
@@ -115,7 +669,7 @@ void VirtualMachine::run() {
                 if (dst < NUM_REGS && src1 < NUM_REGS && src2 < NUM_REGS) {
                     reg[dst] = reg[src1] * reg[src2];
                 } else {
-                    Serial.println("MUL: Invalid register number");
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, max(dst, max(src1, src2)));
                 }
                 break;
             }
@@ -129,11 +683,11 @@ void VirtualMachine::run() {
                     if (reg[src2] != 0) {
                         reg[dst] = reg[src1] / reg[src2];
                     } else {
-                        Serial.println("DIV: Division by zero");
+                        raiseFault(FAULT_DIV_ZERO, instrAddress, src2);
                         reg[dst] = 0;
                     }
                 } else {
-                    Serial.println("DIV: Invalid register number");
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, max(dst, max(src1, src2)));
                 }
                 break;
             }
@@ -143,10 +697,10 @@ void VirtualMachine::run() {
                 uint8_t reg_num = storage.read(pc++);
                 if (reg_num < NUM_REGS) {
                     if (!push(reg[reg_num])) {
-                        Serial.println("PUSH: Stack overflow");
+                        raiseFault(FAULT_STACK_OVERFLOW, instrAddress, sp);
                     }
                 } else {
-                    Serial.println("PUSH: Invalid register number");
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
                 }
                 break;
             }
@@ -159,10 +713,79 @@ void VirtualMachine::run() {
                     if (reg_num < NUM_REGS) {
                         reg[reg_num] = value;
                     } else {
-                        Serial.println("POP: Invalid register number");
+                        raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
+                    }
+                } else {
+                    raiseFault(FAULT_STACK_UNDERFLOW, instrAddress, sp);
+                }
+                break;
+            }
+
+            // Сравнение: CMP dst, src1, src2  => dst = 0 (равно), 1 (больше), 0xFFFFFFFF (меньше)
+            case OP_CMP: {
+                uint8_t dst  = storage.read(pc++);
+                uint8_t src1 = storage.read(pc++);
+                uint8_t src2 = storage.read(pc++);
+                if (dst < NUM_REGS && src1 < NUM_REGS && src2 < NUM_REGS) {
+                    reg[dst] = (reg[src1] == reg[src2]) ? 0 : (reg[src1] > reg[src2]) ? 1 : 0xFFFFFFFF;
+                } else {
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, max(dst, max(src1, src2)));
+                }
+                break;
+            }
+
+            // Безусловный переход: JMP <32-bit addr>
+            case OP_JMP: {
+                uint32_t target = read32(pc);
+                if (target < MEM_SIZE) {
+                    pc = target;
+                } else {
+                    raiseFault(FAULT_BAD_ADDRESS, instrAddress, target, true);
+                }
+                break;
+            }
+
+            // Условные переходы: JZ/JNZ reg, <32-bit addr>
+            case OP_JZ:
+            case OP_JNZ: {
+                uint8_t reg_num = storage.read(pc++);
+                uint32_t target = read32(pc);
+                pc += 4;
+                if (reg_num >= NUM_REGS) {
+                    raiseFault(FAULT_BAD_REGISTER, instrAddress, reg_num);
+                } else if ((reg[reg_num] == 0) == (opcode == OP_JZ)) {
+                    if (target < MEM_SIZE) {
+                        pc = target;
+                    } else {
+                        raiseFault(FAULT_BAD_ADDRESS, instrAddress, target, true);
                     }
+                }
+                break;
+            }
+
+            // Вызов подпрограммы: CALL <32-bit addr>, адрес возврата помещается в стек
+            case OP_CALL: {
+                uint32_t target = read32(pc);
+                pc += 4;
+                if (target >= MEM_SIZE) {
+                    raiseFault(FAULT_BAD_ADDRESS, instrAddress, target, true);
+                } else if (!push(pc)) {
+                    raiseFault(FAULT_STACK_OVERFLOW, instrAddress, sp, true);
                 } else {
-                    Serial.println("POP: Stack underflow");
+                    pc = target;
+                }
+                break;
+            }
+
+            // Возврат из подпрограммы: RET
+            case OP_RET: {
+                uint32_t target;
+                if (!pop(target)) {
+                    raiseFault(FAULT_STACK_UNDERFLOW, instrAddress, sp, true);
+                } else if (target >= MEM_SIZE) {
+                    raiseFault(FAULT_BAD_ADDRESS, instrAddress, target, true);
+                } else {
+                    pc = target;
                 }
                 break;
             }
@@ -181,23 +804,554 @@ void VirtualMachine::run() {
             }
 
             default: {
-                Serial.printf("Unknown opcode: 0x%02X at address 0x%04X\n", opcode, pc - 1);
-                running = false;
+                raiseFault(FAULT_BAD_OPCODE, instrAddress, opcode, true);
                 break;
             }
         }
 
         // Если pc выходит за пределы памяти, останавливаем выполнение
-        if (pc >= MEM_SIZE) {
-            Serial.println("PC reached end of memory. Halting.");
-            running = false;
+        if (pc >= MEM_SIZE && running) {
+            raiseFault(FAULT_PC_END, instrAddress, pc, true);
+        }
+        if (toBlockEnd && endsBlock(opcode)) break;
+    }
+}
+
+// Исполнение через кэш базовых блоков. Операнды уже собраны и проверены при
+// декодировании, поэтому обработчики не делают проверок границ и регистров.
+// Тела обработчиков общие для обоих способов диспетчеризации (VM_DISPATCH).
+// Вариант с Profile = true вызывает profileStep() перед каждой инструкцией,
+// вариант без профилирования не платит за это ничего.
+// pc обновляется только на выходе из движка и при переходах между блоками
+// с неизвестным преемником.
+template <bool Profile>
+void VirtualMachine::runDecodedLoop() {
+    uint8_t* mem = storage.ram;
+    uint32_t* data = storage.data;
+    Block* blk = nullptr;
+    const DecodedInstr* ip = nullptr;
+    int32_t current = enterBlock(pc);
+    if (current < 0) goto fallback;
+    blk = &blocks[current];
+    ip = decoded + blk->first;
+    blk->hits++;
+
+#if VM_DISPATCH == VM_DISPATCH_THREADED
+    static void* const handlers[DOP_COUNT] = {
+        &&L_DOP_HALT, &&L_DOP_LOAD, &&L_DOP_STORE, &&L_DOP_ADD, &&L_DOP_SUB,
+        &&L_DOP_MUL, &&L_DOP_DIV, &&L_DOP_PUSH, &&L_DOP_POP, &&L_DOP_SYSCALL,
+        &&L_DOP_CMP, &&L_DOP_JMP, &&L_DOP_JZ, &&L_DOP_JNZ, &&L_DOP_CALL,
+        &&L_DOP_RET, &&L_DOP_LDW, &&L_DOP_STW, &&L_DOP_TRAP, &&L_DOP_LOAD_ADD, &&L_DOP_LOAD_SUB, &&L_DOP_LOAD_STORE,
+        &&L_DOP_PUSH2, &&L_DOP_PUSH3, &&L_DOP_POP2, &&L_DOP_POP3, &&L_DOP_SUB_JNZ
+    };
+#define HANDLER(op) L_##op:
+#define DISPATCH()  do { executed++; if (Profile) profileStep(ip); goto *handlers[ip->op]; } while (0)
+#else
+#define HANDLER(op) case op:
+#define DISPATCH()  do { executed++; if (Profile) profileStep(ip); goto dispatch; } while (0)
+#endif
+
+// Переход к блоку-преемнику: связь запоминается в текущем блоке,
+// если кэш не был сброшен во время декодирования преемника.
+// Исчерпанный бюджет инструкций проверяется только на границах блоков.
+#define FOLLOW(slot, target) do {                                   \
+        if (executed >= stopAt) { pc = (target); return; }          \
+        int32_t nextBlock = blk->next[slot];                        \
+        if (nextBlock < 0) {                                        \
+            uint32_t epoch = cacheEpoch;                            \
+            nextBlock = enterBlock(target);                         \
+            if (nextBlock < 0) { pc = (target); goto fallback; }    \
+            if (epoch == cacheEpoch) blk->next[slot] = nextBlock;   \
+        }                                                           \
+        blk = &blocks[nextBlock];                                   \
+        blk->hits++;                                                \
+        ip = decoded + blk->first;                                  \
+        DISPATCH();                                                 \
+    } while (0)
+
+// Переход по адресу без запоминания связи (RET, продолжение после сброса кэша)
+#define JUMP_TO(target) do {                                        \
+        pc = (target);                                              \
+        if (executed >= stopAt) return;                             \
+        current = enterBlock(pc);                                   \
+        if (current < 0) goto fallback;                             \
+        blk = &blocks[current];                                     \
+        blk->hits++;                                                \
+        ip = decoded + blk->first;                                  \
+        DISPATCH();                                                 \
+    } while (0)
+
+// Остановка по ошибке (политика STOP): pc указывает на следующую инструкцию,
+// как и в интерпретаторе байткода
+#define STOP_ON_FAULT() do {                                        \
+        if (!running) {                                             \
+            pc = decodedAddr[ip + 1 - decoded];                     \
+            return;                                                 \
+        }                                                           \
+    } while (0)
+
+// Исполнение суперинструкции по одной исходной инструкции интерпретатором байткода
+#define UNFUSE() do {                                               \
+        executed--;                                                 \
+        pc = decodedAddr[ip - decoded];                             \
+        goto fallback;                                              \
+    } while (0)
+
+    running = true;
+    DISPATCH();
+
+#if VM_DISPATCH != VM_DISPATCH_THREADED
+dispatch:
+    switch (ip->op) {
+#endif
+
+    HANDLER(DOP_LOAD) {
+        reg[ip->a] = ip->imm;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_STORE) {
+        uint32_t address = ip->imm;
+        uint32_t value = reg[ip->a];
+        mem[address]     = (value >> 24) & 0xFF;
+        mem[address + 1] = (value >> 16) & 0xFF;
+        mem[address + 2] = (value >> 8) & 0xFF;
+        mem[address + 3] = value & 0xFF;
+        storage.markDirty(address, 4);
+        ip++;
+        if (address < codeHigh && address + 4 > codeLow) {
+            uint32_t resume = decodedAddr[ip - decoded];
+            touchMemory(address, 4);
+            JUMP_TO(resume);
+        }
+        DISPATCH();
+    }
+
+    // Сегмент данных: адрес уже проверен при декодировании и переведён в индекс слова
+    HANDLER(DOP_LDW) {
+        reg[ip->a] = data[ip->imm];
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_STW) {
+        data[ip->imm] = reg[ip->a];
+        storage.markDataWord(ip->imm);
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_ADD) {
+        reg[ip->a] = reg[ip->b] + reg[ip->c];
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_SUB) {
+        reg[ip->a] = reg[ip->b] - reg[ip->c];
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_MUL) {
+        reg[ip->a] = reg[ip->b] * reg[ip->c];
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_DIV) {
+        uint32_t divisor = reg[ip->c];
+        if (divisor != 0) {
+            reg[ip->a] = reg[ip->b] / divisor;
+        } else {
+            raiseFault(FAULT_DIV_ZERO, decodedAddr[ip - decoded], ip->c);
+            reg[ip->a] = 0;
+            STOP_ON_FAULT();
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_CMP) {
+        uint32_t lhs = reg[ip->b];
+        uint32_t rhs = reg[ip->c];
+        reg[ip->a] = (lhs == rhs) ? 0 : (lhs > rhs) ? 1 : 0xFFFFFFFF;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_PUSH) {
+        if (!push(reg[ip->a])) {
+            raiseFault(FAULT_STACK_OVERFLOW, decodedAddr[ip - decoded], sp);
+            STOP_ON_FAULT();
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_POP) {
+        uint32_t value;
+        if (pop(value)) {
+            reg[ip->a] = value;
+        } else {
+            raiseFault(FAULT_STACK_UNDERFLOW, decodedAddr[ip - decoded], sp);
+            STOP_ON_FAULT();
+        }
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_SYSCALL) {
+        uint32_t epoch = cacheEpoch;
+        uint32_t resume = decodedAddr[ip - decoded] + 2;
+        instrAddress = decodedAddr[ip - decoded];
+        handleSystemCall(ip->a);
+        if (!running) {
+            pc = resume;
+            return;
+        }
+        ip++;
+        if (epoch != cacheEpoch) {
+            JUMP_TO(resume);
+        }
+        DISPATCH();
+    }
+
+    HANDLER(DOP_JMP) {
+        FOLLOW(1, ip->imm);
+    }
+
+    HANDLER(DOP_JZ) {
+        if (reg[ip->a] == 0) FOLLOW(1, ip->imm);
+        FOLLOW(0, blk->end);
+    }
+
+    HANDLER(DOP_JNZ) {
+        if (reg[ip->a] != 0) FOLLOW(1, ip->imm);
+        FOLLOW(0, blk->end);
+    }
+
+    HANDLER(DOP_CALL) {
+        if (!push(blk->end)) {
+            raiseFault(FAULT_STACK_OVERFLOW, decodedAddr[ip - decoded], sp, true);
+            pc = blk->end;
+            return;
+        }
+        FOLLOW(1, ip->imm);
+    }
+
+    HANDLER(DOP_RET) {
+        uint32_t target;
+        if (!pop(target)) {
+            raiseFault(FAULT_STACK_UNDERFLOW, decodedAddr[ip - decoded], sp, true);
+            pc = blk->end;
+            return;
         }
+        if (target >= MEM_SIZE) {
+            raiseFault(FAULT_BAD_ADDRESS, decodedAddr[ip - decoded], target, true);
+            pc = blk->end;
+            return;
+        }
+        JUMP_TO(target);
+    }
+
+    HANDLER(DOP_HALT) {
+        pc = blk->end;
+        running = false;
+        return;
+    }
+
+    // Суперинструкции: семантика совпадает с последовательным исполнением исходных инструкций,
+    // счётчик executed учитывает каждую исходную инструкцию
+
+    HANDLER(DOP_LOAD_ADD) {
+        reg[ip->c] = ip->imm;
+        reg[ip->a] = reg[ip->b] + ip->imm;
+        executed += 1;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_LOAD_SUB) {
+        reg[ip->c] = ip->imm;
+        reg[ip->a] = reg[ip->b] - ip->imm;
+        executed += 1;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_LOAD_STORE) {
+        uint32_t value = ip->imm;
+        uint32_t address = ip[1].imm;
+        reg[ip->a] = value;
+        mem[address]     = (value >> 24) & 0xFF;
+        mem[address + 1] = (value >> 16) & 0xFF;
+        mem[address + 2] = (value >> 8) & 0xFF;
+        mem[address + 3] = value & 0xFF;
+        storage.markDirty(address, 4);
+        executed += 1;
+        ip += 2;
+        if (address < codeHigh && address + 4 > codeLow) {
+            uint32_t resume = decodedAddr[ip - decoded];
+            touchMemory(address, 4);
+            JUMP_TO(resume);
+        }
+        DISPATCH();
+    }
+
+    // Групповые PUSH/POP проверяют место в стеке один раз; если его не хватает,
+    // инструкции исполняются по одной интерпретатором байткода, который и запишет ошибку
+
+    HANDLER(DOP_PUSH2) {
+        if (sp < 2) UNFUSE();
+        stack[sp--] = reg[ip->a];
+        stack[sp--] = reg[ip->b];
+        executed += 1;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_PUSH3) {
+        if (sp < 3) UNFUSE();
+        stack[sp--] = reg[ip->a];
+        stack[sp--] = reg[ip->b];
+        stack[sp--] = reg[ip->c];
+        executed += 2;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_POP2) {
+        if (sp + 2 > STACK_SIZE - 1) UNFUSE();
+        reg[ip->a] = stack[++sp];
+        reg[ip->b] = stack[++sp];
+        executed += 1;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_POP3) {
+        if (sp + 3 > STACK_SIZE - 1) UNFUSE();
+        reg[ip->a] = stack[++sp];
+        reg[ip->b] = stack[++sp];
+        reg[ip->c] = stack[++sp];
+        executed += 2;
+        ip++;
+        DISPATCH();
+    }
+
+    HANDLER(DOP_SUB_JNZ) {
+        reg[ip->a] = reg[ip->b] - reg[ip->c];
+        executed += 1;
+        if (reg[ip->a] != 0) FOLLOW(1, ip->imm);
+        FOLLOW(0, blk->end);
+    }
+
+    HANDLER(DOP_TRAP) {
+        // Некорректная инструкция: её исполнит и опишет интерпретатор байткода
+        executed--;
+        pc = ip->imm;
+        goto fallback;
+    }
+
+#if VM_DISPATCH != VM_DISPATCH_THREADED
+    default:
+        break;
+    }
+#endif
+
+    // TRAP, разобранная суперинструкция или блок, которому не хватило места в пуле:
+    // интерпретатор байткода исполняет код до конца базового блока, а затем исполнение
+    // возвращается к декодированным блокам, чтобы одна редкая инструкция в горячем
+    // цикле не переводила весь срез на медленный движок
+fallback:
+    runSwitch(true);
+    if (!running || executed >= stopAt) return;
+    current = enterBlock(pc);
+    if (current < 0) goto fallback;
+    blk = &blocks[current];
+    blk->hits++;
+    ip = decoded + blk->first;
+    DISPATCH();
+
+#undef UNFUSE
+#undef STOP_ON_FAULT
+#undef JUMP_TO
+#undef FOLLOW
+#undef HANDLER
+#undef DISPATCH
+}
+
+void VirtualMachine::runDecoded() {
+    if (profile) {
+        runDecodedLoop<true>();
+        profileFinish();
+    } else {
+        runDecodedLoop<false>();
+    }
+}
+
+// Учёт инструкции перед её исполнением: интервал с прошлой отметки относится
+// к предыдущей инструкции; собственные накладные расходы из интервалов исключены
+void VirtualMachine::profileStep(const DecodedInstr* ip) {
+    uint32_t now = ESP.getCycleCount();
+    if (profile->lastOpcode >= 0) {
+        profile->opcodeCycles[profile->lastOpcode] += now - profile->lastCycles;
+    }
+    uint32_t address = decodedAddr[ip - decoded];
+    uint8_t opcode = storage.ram[address];
+    profile->opcodeCount[opcode]++;
+    profile->pcCount[address]++;
+    profile->lastOpcode = opcode;
+    profile->lastCycles = ESP.getCycleCount();
+}
+
+void VirtualMachine::profileFinish() {
+    if (profile->lastOpcode >= 0) {
+        profile->opcodeCycles[profile->lastOpcode] += ESP.getCycleCount() - profile->lastCycles;
+        profile->lastOpcode = -1;
+    }
+}
+
+// Включение профилировщика выделяет и обнуляет счётчики, выключение освобождает их
+bool VirtualMachine::setProfiling(bool enabled) {
+    if (!enabled) {
+        delete profile;
+        profile = nullptr;
+        return true;
+    }
+    if (!profile) {
+        profile = new (std::nothrow) VmProfile;
+        if (!profile) return false;
+    }
+    memset(profile, 0, sizeof(VmProfile));
+    profile->lastOpcode = -1;
+    return true;
+}
+
+// Статистика последовательностей опкодов: для каждого исполненного блока исходный
+// байткод просматривается окном из 2 и 3 инструкций, вес окна — число входов в блок.
+// Последовательности, пересекающие границу блока, не учитываются (их нельзя слить).
+uint32_t VirtualMachine::collectSequences(OpcodeSequence* out, uint32_t max) const {
+    OpcodeSequence table[SEQUENCE_STATS_MAX];
+    uint32_t used = 0;
+
+    for (uint32_t b = 0; b < blockCount; b++) {
+        const Block& blk = blocks[b];
+        if (blk.hits == 0) continue;
+
+        uint8_t window[3] = {0};
+        uint32_t filled = 0;
+        uint32_t addr = blk.start;
+        while (addr < blk.end) {
+            uint8_t opcode = storage.ram[addr];
+            uint32_t length = instructionLength(opcode);
+            if (length == 0) break;
+            window[0] = window[1];
+            window[1] = window[2];
+            window[2] = opcode;
+            filled++;
+            addr += length;
+
+            for (uint8_t len = 2; len <= 3; len++) {
+                if (filled < len) continue;
+                const uint8_t* ops = window + 3 - len;
+                uint32_t i = 0;
+                while (i < used && !(table[i].length == len && memcmp(table[i].ops, ops, len) == 0)) i++;
+                if (i == used) {
+                    if (used == SEQUENCE_STATS_MAX) continue;
+                    OpcodeSequence& seq = table[used++];
+                    seq.length = len;
+                    memset(seq.ops, 0, sizeof(seq.ops));
+                    memcpy(seq.ops, ops, len);
+                    seq.count = 0;
+                    seq.fused = false;
+                    for (uint32_t r = 0; r < fusionRuleCount; r++) {
+                        if (fusionRules[r].length == len && memcmp(fusionRules[r].opcodes, ops, len) == 0) {
+                            seq.fused = true;
+                        }
+                    }
+                }
+                table[i].count += blk.hits;
+            }
+        }
+    }
+
+    // Сортировка вставками по убыванию числа исполнений
+    for (uint32_t i = 1; i < used; i++) {
+        OpcodeSequence key = table[i];
+        int32_t j = i - 1;
+        while (j >= 0 && table[j].count < key.count) {
+            table[j + 1] = table[j];
+            j--;
+        }
+        table[j + 1] = key;
+    }
+
+    uint32_t count = min(used, max);
+    memcpy(out, table, count * sizeof(OpcodeSequence));
+    return count;
+}
+
+// Запись ошибки. Сохраняется первая ошибка запуска, остальные только подсчитываются
+void VirtualMachine::raiseFault(VmFaultCode code, uint32_t address, uint32_t operand, bool fatal) {
+    if (lastFault.count++ == 0) {
+        lastFault.code = code;
+        lastFault.opcode = storage.read(address);
+        lastFault.pc = address;
+        lastFault.operand = operand;
+    }
+    if (fatal || faultPolicy == FAULT_POLICY_STOP) {
+        running = false;
+    }
+}
+
+const char* faultName(VmFaultCode code) {
+    switch (code) {
+        case FAULT_NONE:             return "No fault";
+        case FAULT_BAD_REGISTER:     return "Invalid register number";
+        case FAULT_BAD_ADDRESS:      return "Address out of bounds";
+        case FAULT_DIV_ZERO:         return "Division by zero";
+        case FAULT_STACK_OVERFLOW:   return "Stack overflow";
+        case FAULT_STACK_UNDERFLOW:  return "Stack underflow";
+        case FAULT_BAD_OPCODE:       return "Unknown opcode";
+        case FAULT_BAD_SYSCALL:      return "Unknown system call";
+        case FAULT_MEMORY_VIOLATION: return "Memory access violation";
+        case FAULT_PC_END:           return "PC reached end of memory";
+        case FAULT_READONLY:         return "Write to read-only data";
+        case FAULT_NO_PROGRESS:      return "Program made no progress";
+        default:                     return "?";
+    }
+}
+
+const char* opcodeName(uint8_t opcode) {
+    switch (opcode) {
+        case OP_HALT:    return "HALT";
+        case OP_JMP:     return "JMP";
+        case OP_CALL:    return "CALL";
+        case OP_RET:     return "RET";
+        case OP_JZ:      return "JZ";
+        case OP_JNZ:     return "JNZ";
+        case OP_LOAD:    return "LOAD";
+        case OP_STORE:   return "STORE";
+        case OP_LDW:     return "LDW";
+        case OP_STW:     return "STW";
+        case OP_ADD:     return "ADD";
+        case OP_SUB:     return "SUB";
+        case OP_MUL:     return "MUL";
+        case OP_DIV:     return "DIV";
+        case OP_CMP:     return "CMP";
+        case OP_PUSH:    return "PUSH";
+        case OP_POP:     return "POP";
+        case OP_SYSCALL: return "SYSCALL";
+        default:         return "?";
     }
 }
 
 // Сохранение состояния памяти на файловую систему
-void VirtualMachine::persistState() {
-    storage.persist();
+int32_t VirtualMachine::persistState() {
+    return storage.persist();
 }
 
 // Вывод текущего состояния ВМ (PC, регистры)
@@ -214,12 +1368,19 @@ void VirtualMachine::printState() {
 void VirtualMachine::handleSystemCall(uint8_t code) {
     switch (code) {
         // Печать строки, расположенной в памяти по адресу, хранящемуся в reg[0]
+        // (в образе с сегментами адрес — в сегменте данных)
         case 0x01: { // PRINT_STRING
             uint32_t addr = reg[0];
-            while (addr < MEM_SIZE) {
-                char c = storage.read(addr++);
-                if (c == 0) break;
-                Serial.print(c);
+            const uint8_t* memory = segmented ? reinterpret_cast<const uint8_t*>(storage.data) : storage.ram;
+            uint32_t limit = segmented ? DATA_SIZE : MEM_SIZE;
+            if (addr >= limit) break;
+            const char* text = reinterpret_cast<const char*>(memory + addr);
+            const void* end = memchr(text, 0, limit - addr);
+            size_t length = end ? static_cast<const char*>(end) - text : limit - addr;
+            if (outputHandler) {
+                outputHandler(text, length, outputContext);
+            } else {
+                Serial.write(reinterpret_cast<const uint8_t*>(text), length);
             }
             break;
         }
@@ -228,17 +1389,39 @@ void VirtualMachine::handleSystemCall(uint8_t code) {
             uint32_t dest_addr = reg[0]; // Адрес в памяти, куда копировать данные
             uint32_t data_addr = reg[1]; // Адрес данных в памяти
             uint32_t length    = reg[2]; // Длина данных
+            if (segmented) {
+                // Копирование внутри сегмента данных; rodata может быть только источником
+                uint8_t* bytes = reinterpret_cast<uint8_t*>(storage.data);
+                if (dest_addr >= DATA_SIZE || data_addr >= DATA_SIZE ||
+                    length > DATA_SIZE - dest_addr || length > DATA_SIZE - data_addr) {
+                    raiseFault(FAULT_MEMORY_VIOLATION, instrAddress, dest_addr);
+                } else if (dest_addr < rodataEnd && length > 0) {
+                    raiseFault(FAULT_READONLY, instrAddress, dest_addr);
+                } else {
+                    memmove(bytes + dest_addr, bytes + data_addr, length);
+                    storage.markDirty(MEM_SIZE + dest_addr, length);
+                }
+                break;
+            }
             for (uint32_t i = 0; i < length; i++) {
                 if ((dest_addr + i) >= MEM_SIZE || (data_addr + i) >= MEM_SIZE) {
-                    Serial.println("LOAD_DATA: Memory access violation");
+                    raiseFault(FAULT_MEMORY_VIOLATION, instrAddress,
+                               (dest_addr + i) >= MEM_SIZE ? dest_addr + i : data_addr + i);
                     break;
                 }
                 storage.write(dest_addr + i, storage.read(data_addr + i));
             }
+            touchMemory(dest_addr, length);
+            break;
+        }
+        // Контрольная точка: сохранение изменённых страниц памяти, в reg[0] —
+        // число записанных страниц (0xFFFFFFFF — ошибка записи)
+        case 0x03: { // CHECKPOINT
+            reg[0] = static_cast<uint32_t>(storage.persist());
             break;
         }
         default:
-            Serial.printf("Unknown system call: 0x%02X\n", code);
+            raiseFault(FAULT_BAD_SYSCALL, instrAddress, code);
             break;
     }
 }
@@ -0,0 +1,170 @@
+#include "vm_worker.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
+#include <commands/utils.h>
+#include <atomic>
+
+#if !defined(ARDUINO_ARCH_ESP32)
+#include <chrono>
+#include <thread>
+#endif
+
+static SpscQueue<WorkerRequest, WORKER_REQUESTS> requests;  // консоль -> задача ВМ
+static SpscQueue<WorkerMessage, WORKER_MESSAGES> messages;  // задача ВМ -> консоль
+static std::atomic<bool> started{false};
+
+// ---- Платформенная часть: создание задачи и уступка процессора ----
+
+static void workerLoop();
+
+#if defined(ARDUINO_ARCH_ESP32)
+static void workerTask(void*) {
+    workerLoop();
+}
+
+static bool startTask() {
+    return xTaskCreatePinnedToCore(workerTask, "vm-worker", WORKER_STACK_SIZE, nullptr,
+                                   WORKER_PRIORITY, nullptr, WORKER_CORE) == pdPASS;
+}
+
+static void yieldWorker() { taskYIELD(); }
+static void idleWorker()  { vTaskDelay(1); }
+#else
+static bool startTask() {
+    std::thread(workerLoop).detach();
+    return true;
+}
+
+static void yieldWorker() { std::this_thread::yield(); }
+static void idleWorker()  { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+#endif
+
+// ---- Задача ВМ ----
+
+// Отправка текста консоли; при заполненной очереди задача ждёт, пока консоль её разберёт
+static void sendText(const char* text, size_t length, uint16_t reply) {
+    do {
+        WorkerMessage message;
+        size_t chunk = min(length, sizeof(message.text) - 1);
+        memcpy(message.text, text, chunk);
+        message.text[chunk] = 0;
+        text += chunk;
+        length -= chunk;
+        message.reply = length == 0 ? reply : 0;
+        while (!messages.push(message)) {
+            idleWorker();
+        }
+    } while (length > 0);
+}
+
+static void sendReport(const String& text) {
+    sendText(text.c_str(), text.length(), 0);
+}
+
+static void sendProgramOutput(const char* text, size_t length, void*) {
+    if (length > 0) sendText(text, length, 0);
+}
+
+static void handleRequest(const WorkerRequest& request) {
+    String reply;
+    switch (request.type) {
+        case WORKER_SPAWN: {
+            File file = LittleFS.open(request.path, "r");
+            if (!file) {
+                reply = "File not found: " + String(request.path) + "\n";
+                break;
+            }
+            reply = spawnMessage(scheduler.spawn(file, request.path), request.path);
+            file.close();
+            break;
+        }
+        case WORKER_KILL:
+            if (!scheduler.kill(request.id)) {
+                reply = "No such program: " + String(request.id) + "\n";
+            }
+            break;
+        case WORKER_PS:
+            reply = scheduler.listing();
+            break;
+    }
+    sendText(reply.c_str(), reply.length(), request.sequence);
+}
+
+static void workerLoop() {
+    uint32_t ticks = 0;
+    while (true) {
+        WorkerRequest request;
+        while (requests.pop(request)) {
+            handleRequest(request);
+        }
+        if (scheduler.count() > 0) {
+            scheduler.tick();
+            if (++ticks % WORKER_IDLE_TICKS == 0) {
+                idleWorker();   // Даёт поработать задаче IDLE этого ядра
+            } else {
+                yieldWorker();
+            }
+        } else {
+            idleWorker();
+        }
+    }
+}
+
+// ---- Сторона консоли ----
+
+bool workerStart() {
+    if (started.load()) return true;
+    scheduler.setReporter(sendReport);
+    scheduler.setProgramOutput(sendProgramOutput);
+    if (!startTask()) {
+        scheduler.setReporter(nullptr);
+        scheduler.setProgramOutput(nullptr);
+        return false;
+    }
+    started.store(true);
+    return true;
+}
+
+bool workerActive() {
+    return started.load(std::memory_order_relaxed);
+}
+
+// Вывод сообщений; true — встретился конец ответа на запрос awaited (0 — ответ не ждём)
+static bool drainMessages(uint16_t awaited) {
+    WorkerMessage message;
+    bool replied = false;
+    while (messages.pop(message)) {
+        if (message.text[0]) writeOutput(message.text);
+        if (awaited != 0 && message.reply == awaited) replied = true;
+    }
+    return replied;
+}
+
+bool workerCall(const WorkerRequest& call) {
+    static uint16_t nextSequence = 0;
+    WorkerRequest request = call;
+    if (++nextSequence == 0) nextSequence = 1;   // 0 зарезервирован за «не ответ»
+    request.sequence = nextSequence;
+
+    unsigned long start = millis();
+    while (!requests.push(request)) {
+        drainMessages(0);
+        if (millis() - start > WORKER_REPLY_TIMEOUT) {
+            writeOutput("VM worker is not responding\n");
+            return false;
+        }
+        delay(1);
+    }
+    while (!drainMessages(request.sequence)) {
+        if (millis() - start > WORKER_REPLY_TIMEOUT) {
+            writeOutput("VM worker is not responding\n");
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+void workerDrain() {
+    drainMessages(0);
+}
@@ -0,0 +1,150 @@
+// Регрессионные тесты ВМ для хостовой сборки: pio test -e native
+//
+// Каждая программа исполняется в трёх режимах — со слиянием суперинструкций,
+// с декодированием без слияния и интерпретатором байткода — и результаты
+// должны совпадать.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "vm.h"
+
+static VirtualMachine* vm = nullptr;
+
+enum RunMode { MODE_FUSED, MODE_DECODED, MODE_RAW };
+static const RunMode modes[] = {MODE_FUSED, MODE_DECODED, MODE_RAW};
+
+// Память ВМ целиком: байты за концом программы обнуляются
+struct Program {
+    uint8_t code[MEM_SIZE] = {0};
+    size_t size = 0;
+
+    void emit(uint8_t b) { code[size++] = b; }
+    void emit32(uint32_t v) {
+        emit((v >> 24) & 0xFF);
+        emit((v >> 16) & 0xFF);
+        emit((v >> 8) & 0xFF);
+        emit(v & 0xFF);
+    }
+};
+
+static void runProgram(const Program& program, RunMode mode, uint32_t budget = 0) {
+    vm->reset();   // Регистры сохраняются между загрузками программ
+    vm->setFusion(mode == MODE_FUSED);
+    TEST_ASSERT_TRUE(vm->loadProgram(program.code, MEM_SIZE, mode != MODE_RAW));
+    vm->run(budget);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// STORE по адресу у конца 32-битного диапазона: address + 3 переполняется,
+// запись должна завершиться ошибкой, а не выйти за пределы памяти
+static void test_store_wrapping_address() {
+    Program p;
+    p.emit(OP_LOAD);  p.emit(0); p.emit32(0x12345678);
+    p.emit(OP_STORE); p.emit(0); p.emit32(0xFFFFFFFE);
+    p.emit(OP_HALT);
+    for (RunMode mode : modes) {
+        runProgram(p, mode);
+        TEST_ASSERT_FALSE(vm->isRunning());
+        TEST_ASSERT_EQUAL(FAULT_BAD_ADDRESS, vm->fault().code);
+        TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFE, vm->fault().operand);
+        TEST_ASSERT_EQUAL_HEX8(OP_LOAD, vm->peek(0));
+    }
+}
+
+// Код, заканчивающийся ровно на границе памяти: после последней инструкции
+// декодированный движок и интерпретатор байткода должны одинаково остановиться
+// с FAULT_PC_END, а не оставить ВМ в состоянии «выполняется»
+static void expectPcEnd(const Program& p) {
+    uint32_t counts[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        runProgram(p, modes[i]);
+        TEST_ASSERT_FALSE(vm->isRunning());
+        TEST_ASSERT_EQUAL(FAULT_PC_END, vm->fault().code);
+        TEST_ASSERT_EQUAL_UINT32(MEM_SIZE, vm->fault().operand);
+        counts[i] = vm->instructionCount();
+    }
+    TEST_ASSERT_EQUAL_UINT32(counts[MODE_RAW], counts[MODE_FUSED]);
+    TEST_ASSERT_EQUAL_UINT32(counts[MODE_RAW], counts[MODE_DECODED]);
+}
+
+// Невыполненный JNZ в последних байтах памяти: преемник блока — адрес MEM_SIZE
+static void test_branch_falls_off_end() {
+    Program p;
+    p.emit(OP_JMP); p.emit32(MEM_SIZE - 6);
+    p.size = MEM_SIZE - 6;
+    p.emit(OP_JNZ); p.emit(0); p.emit32(0);
+    expectPcEnd(p);
+}
+
+// Линейный код до конца памяти: блок заканчивается TRAP с адресом MEM_SIZE
+static void test_code_runs_off_end() {
+    Program p;
+    while (p.size < MEM_SIZE) {
+        p.emit(OP_ADD); p.emit(0); p.emit(0); p.emit(0);
+    }
+    expectPcEnd(p);
+}
+
+// Бюджет исчерпан ровно на границе памяти: следующий run() сообщает об ошибке
+static void test_resume_at_end() {
+    Program p;
+    p.emit(OP_JMP); p.emit32(MEM_SIZE - 6);
+    p.size = MEM_SIZE - 6;
+    p.emit(OP_JNZ); p.emit(0); p.emit32(0);
+    for (RunMode mode : modes) {
+        runProgram(p, mode, 1);
+        for (uint32_t slice = 0; slice < 4 && vm->isRunning(); slice++) vm->run(1);
+        TEST_ASSERT_FALSE(vm->isRunning());
+        TEST_ASSERT_EQUAL(FAULT_PC_END, vm->fault().code);
+    }
+}
+
+// Некорректная инструкция перед горячим циклом: после неё цикл снова исполняется
+// декодированным движком (профилировщик считает только декодированные инструкции)
+static void test_trap_returns_to_decoded() {
+    Program p;
+    p.emit(OP_LOAD); p.emit(1); p.emit32(100);
+    p.emit(OP_LOAD); p.emit(2); p.emit32(1);
+    p.emit(OP_LOAD); p.emit(NUM_REGS); p.emit32(0);   // Неверный регистр: TRAP
+    uint32_t top = p.size;
+    p.emit(OP_SUB); p.emit(1); p.emit(1); p.emit(2);
+    p.emit(OP_JNZ); p.emit(1); p.emit32(top);
+    p.emit(OP_HALT);
+
+    vm->setFaultPolicy(FAULT_POLICY_CONTINUE);
+    uint32_t counts[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        runProgram(p, modes[i]);
+        TEST_ASSERT_FALSE(vm->isRunning());
+        TEST_ASSERT_EQUAL(FAULT_BAD_REGISTER, vm->fault().code);
+        counts[i] = vm->instructionCount();
+    }
+    TEST_ASSERT_EQUAL_UINT32(counts[MODE_RAW], counts[MODE_FUSED]);
+    TEST_ASSERT_EQUAL_UINT32(counts[MODE_RAW], counts[MODE_DECODED]);
+
+    TEST_ASSERT_TRUE(vm->setProfiling(true));
+    runProgram(p, MODE_DECODED);
+    TEST_ASSERT_EQUAL_UINT32(counts[MODE_RAW], vm->instructionCount());
+    TEST_ASSERT_EQUAL_UINT32(99, vm->profileData()->opcodeCount[OP_SUB]);
+    vm->setProfiling(false);
+    vm->setFaultPolicy(FAULT_POLICY_STOP);
+}
+
+int main(int argc, char** argv) {
+    // ВМ хранит состояние в /system/systemdata.dat, поэтому каталог должен существовать
+    LittleFS.begin(true);
+    if (!LittleFS.exists("/system")) LittleFS.mkdir("/system");
+    vm = new VirtualMachine();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_store_wrapping_address);
+    RUN_TEST(test_branch_falls_off_end);
+    RUN_TEST(test_code_runs_off_end);
+    RUN_TEST(test_resume_at_end);
+    RUN_TEST(test_trap_returns_to_decoded);
+    int failures = UNITY_END();
+    delete vm;
+    return failures;
+}